@@ -1,3 +1,4 @@
+#include <cstring>
 #include <algorithm>
 #include "image.h"
 
@@ -13,6 +14,18 @@ std::vector<ppgso::Image::Pixel>& ppgso::Image::getFramebuffer() {
   return framebuffer;
 }
 
+const std::vector<ppgso::Image::Pixel>& ppgso::Image::getFramebuffer() const {
+  return framebuffer;
+}
+
+ppgso::ImageSpan<ppgso::Image::Pixel> ppgso::Image::span() {
+  return {framebuffer.data(), width, height, width * sizeof(Pixel)};
+}
+
+ppgso::ImageView<ppgso::Image::Pixel> ppgso::Image::view() const {
+  return {framebuffer.data(), width, height, width * sizeof(Pixel)};
+}
+
 ppgso::Image::Pixel& ppgso::Image::getPixel(int x, int y) {
   return framebuffer[x+y*width];
 }
@@ -22,7 +35,44 @@ void ppgso::Image::setPixel(int x, int y, const Image::Pixel& color) {
 }
 
 void ppgso::Image::clear(const ppgso::Image::Pixel &color) {
-  framebuffer = std::vector<Pixel>(framebuffer.size(), color);
+  fill(span(), color);
+}
+
+void ppgso::Image::clear(const ppgso::Image::Pixel &color, int x, int y, int width, int height) {
+  fill(span().crop(x, y, width, height), color);
+}
+
+/*!
+ * Fill a run of pixels with single color
+ * Gray colors are a plain memset, other colors copy a block holding a whole number of pixels so the 3 byte pattern
+ * is written with wide stores
+ * @param pixels First pixel to fill
+ * @param count Number of pixels to fill
+ * @param color Color to fill with
+ */
+static void fillPixels(ppgso::Image::Pixel *pixels, size_t count, const ppgso::Image::Pixel &color) {
+  if (color.r == color.g && color.g == color.b) {
+    std::memset(pixels, color.r, count * sizeof(ppgso::Image::Pixel));
+    return;
+  }
+
+  const size_t BLOCK = 64;
+  ppgso::Image::Pixel block[BLOCK];
+  std::fill_n(block, std::min(count, BLOCK), color);
+  size_t i = 0;
+  for (; i + BLOCK <= count; i += BLOCK)
+    std::memcpy(pixels + i, block, sizeof(block));
+  std::memcpy(pixels + i, block, (count - i) * sizeof(ppgso::Image::Pixel));
+}
+
+void ppgso::Image::fill(const ImageSpan<Pixel> &span, const Pixel &color) {
+  if (span.empty()) return;
+  if (span.isContiguous()) {
+    fillPixels(span.data, (size_t) span.width * span.height, color);
+  } else {
+    for (int y = 0; y < span.height; y++)
+      fillPixels(span.row(y), span.width, color);
+  }
 }
 
 void ppgso::Image::setPixel(int x, int y, int r, int g, int b) {
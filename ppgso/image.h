@@ -4,6 +4,8 @@
 #include <memory>
 #include <fstream>
 
+#include "image_view.h"
+
 namespace ppgso {
 
   class Image {
@@ -26,6 +28,21 @@ namespace ppgso {
      * @return - Pointer to the raw RGB framebuffer data.
      */
     std::vector<Pixel>& getFramebuffer();
+    const std::vector<Pixel>& getFramebuffer() const;
+
+    /*!
+     * Get writable view of all pixels, tiles and crops of it share the framebuffer.
+     *
+     * @return - Span of the whole image.
+     */
+    ImageSpan<Pixel> span();
+
+    /*!
+     * Get read only view of all pixels.
+     *
+     * @return - View of the whole image.
+     */
+    ImageView<Pixel> view() const;
 
     /*!
      * Get single pixel from the framebuffer.
@@ -65,11 +82,28 @@ namespace ppgso {
     void setPixel(int x, int y, float r, float g, float b);
 
     /*!
-     * Clear the image using single color
+     * Clear the image using single color, the framebuffer is filled in place
      * @param color Pixel color to set the image to
      */
     void clear(const Pixel& color = {0,0,0});
 
+    /*!
+     * Clear a rectangle of the image using single color, the rectangle is limited to the image
+     * @param color Pixel color to set the rectangle to
+     * @param x Horizontal coordinate of the top left corner
+     * @param y Vertical coordinate of the top left corner
+     * @param width Width of the rectangle
+     * @param height Height of the rectangle
+     */
+    void clear(const Pixel& color, int x, int y, int width, int height);
+
+    /*!
+     * Set all pixels of a span to single color, contiguous spans are filled as a single run
+     * @param span Pixels to fill, may be a crop or tile of a larger image
+     * @param color Pixel color to set
+     */
+    static void fill(const ImageSpan<Pixel>& span, const Pixel& color);
+
     int width, height;
   private:
     std::vector<Pixel> framebuffer;
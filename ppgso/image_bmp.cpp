@@ -1,8 +1,14 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
 #include "image_bmp.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
 namespace ppgso {
   namespace image {
 
@@ -33,6 +39,67 @@ namespace ppgso {
     } BITMAPINFOHEADER;
 #pragma pack()
 
+    // Supported compression methods
+    const unsigned int BMP_RGB = 0;
+    const unsigned int BMP_BITFIELDS = 3;
+
+    /*!
+     * Swap red and blue channels of packed 24 bit pixels, converts between BGR and RGB.
+     * Source and destination may be the same buffer. The vector loop converts blocks of 48 bytes (16 pixels), each byte
+     * is either kept or moved by two bytes within its pixel so only shifts and masks are needed.
+     *
+     * @param source - Pixels to convert.
+     * @param destination - Converted pixels.
+     * @param pixels - Number of pixels.
+     */
+    static void swapRedBlue(const uint8_t *source, uint8_t *destination, int pixels) {
+      size_t size = (size_t) pixels * 3, i = 0;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+      // Byte masks of the green, blue and red positions in a 48 byte block
+      alignas(16) static const uint8_t masks[3][48] = {
+        {0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0},
+        {0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255},
+        {255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0,255,0,0},
+      };
+
+      for (; i + 48 <= size; i += 48) {
+        __m128i block[5] = {_mm_setzero_si128(), _mm_loadu_si128((const __m128i *) (source + i)),
+                            _mm_loadu_si128((const __m128i *) (source + i + 16)),
+                            _mm_loadu_si128((const __m128i *) (source + i + 32)), _mm_setzero_si128()};
+        for (int k = 0; k < 3; k++) {
+          // Bytes two positions before and after, neighbours outside of the block are masked out anyway
+          auto before = _mm_or_si128(_mm_slli_si128(block[k + 1], 2), _mm_srli_si128(block[k], 14));
+          auto after = _mm_or_si128(_mm_srli_si128(block[k + 1], 2), _mm_slli_si128(block[k + 2], 14));
+          auto green = _mm_and_si128(block[k + 1], _mm_load_si128((const __m128i *) &masks[0][k * 16]));
+          auto blue = _mm_and_si128(before, _mm_load_si128((const __m128i *) &masks[1][k * 16]));
+          auto red = _mm_and_si128(after, _mm_load_si128((const __m128i *) &masks[2][k * 16]));
+          _mm_storeu_si128((__m128i *) (destination + i + k * 16), _mm_or_si128(green, _mm_or_si128(blue, red)));
+        }
+      }
+#endif
+      for (; i < size; i += 3) {
+        uint8_t red = source[i], green = source[i + 1], blue = source[i + 2];
+        destination[i] = blue;
+        destination[i + 1] = green;
+        destination[i + 2] = red;
+      }
+    }
+
+    /*!
+     * Convert 32 bit BGRX pixels to RGB, the fourth byte is dropped.
+     *
+     * @param source - Pixels to convert.
+     * @param destination - Converted pixels.
+     * @param pixels - Number of pixels.
+     */
+    static void convertBGRX(const uint8_t *source, uint8_t *destination, int pixels) {
+      for (int i = 0; i < pixels; i++) {
+        destination[i * 3] = source[i * 4 + 2];
+        destination[i * 3 + 1] = source[i * 4 + 1];
+        destination[i * 3 + 2] = source[i * 4];
+      }
+    }
+
     Image loadBMP(const std::string &bmp) {
       BITMAPFILEHEADER bmpFileHeader = {};
       BITMAPINFOHEADER bmpInfoHeader = {};
@@ -55,13 +122,21 @@ namespace ppgso {
         throw std::runtime_error(msg.str());
       }
 
-      if (bmpInfoHeader.biBitCount != 24) {
+      int bytesPerPixel = bmpInfoHeader.biBitCount / 8;
+      if (bmpInfoHeader.biBitCount != 24 && bmpInfoHeader.biBitCount != 32) {
         std::stringstream msg;
         msg << "BMP file does not contain supported bit count. " << bmp;
         throw std::runtime_error(msg.str());
       }
 
-      if (bmpInfoHeader.biCompression != 0) { // BI_RGB only
+      // 32 bit images may use bit fields, only the common BGRX layout is supported
+      bool bitfields = bmpInfoHeader.biCompression == BMP_BITFIELDS && bmpInfoHeader.biBitCount == 32;
+      if (bitfields) {
+        unsigned int masks[3] = {};
+        input_file.read((char *) masks, sizeof(masks));
+        bitfields = masks[0] == 0x00ff0000 && masks[1] == 0x0000ff00 && masks[2] == 0x000000ff;
+      }
+      if (bmpInfoHeader.biCompression != BMP_RGB && !bitfields) {
         std::stringstream msg;
         msg << "BMP file does not use expected compression method. " << bmp;
         throw std::runtime_error(msg.str());
@@ -69,45 +144,72 @@ namespace ppgso {
 
       int width = bmpInfoHeader.biWidth;
       int height = abs(bmpInfoHeader.biHeight);
-      bool flipped = bmpInfoHeader.biHeight < 0;
+      bool topDown = bmpInfoHeader.biHeight < 0;
 
-      if (width == 0 || height == 0) {
+      if (width <= 0 || height == 0) {
         std::stringstream msg;
         msg << "BMP file does not contain any data. " << bmp;
         throw std::runtime_error(msg.str());
       }
 
       Image image{width, height};
-      auto &framebuffer = image.getFramebuffer();
-
-      // Load data
-      input_file.seekg(bmpFileHeader.bfOffBits, input_file.beg);
+      auto framebuffer = (uint8_t *) image.getFramebuffer().data();
+      size_t rowSize = (size_t) width * sizeof(Image::Pixel);
 
       // BMP uses padding for rows
-      unsigned int row_padded = (width * sizeof(Image::Pixel) + 3) & (~3);
+      size_t row_padded = ((size_t) width * bytesPerPixel + 3) & (~3);
 
-      for (int j = 0; j < height; j++) {
-        auto row_data = std::vector<Image::Pixel>(row_padded);
-        input_file.read((char *) row_data.data(), row_padded);
-        for (int i = 0; i < width; i++) {
-          auto pixel = row_data[i];
-          std::swap(pixel.r, pixel.b);
-          if (flipped) {
-            framebuffer[i + j * width] = pixel;
+      // Load all pixel data with a single read, directly into the framebuffer when the rows match it
+      input_file.seekg(bmpFileHeader.bfOffBits, input_file.beg);
+      bool direct = bytesPerPixel == 3 && row_padded == rowSize;
+      std::vector<uint8_t> data;
+      if (!direct) data.resize(row_padded * height);
+      auto pixels = direct ? framebuffer : data.data();
+      input_file.read((char *) pixels, row_padded * height);
+
+      // Padding of the last row is optional
+      if ((size_t) input_file.gcount() < row_padded * (height - 1) + (size_t) width * bytesPerPixel) {
+        std::stringstream msg;
+        msg << "BMP file is truncated. " << bmp;
+        throw std::runtime_error(msg.str());
+      }
+
+      if (direct) {
+        // Convert in place, bottom up images exchange pairs of rows through a single row buffer
+        std::vector<uint8_t> row(topDown ? 0 : rowSize);
+        for (int j = 0; j < (height + 1) / 2; j++) {
+          auto top = framebuffer + j * rowSize;
+          auto bottom = framebuffer + (height - 1 - j) * rowSize;
+          if (topDown || top == bottom) {
+            swapRedBlue(top, top, width);
+            if (top != bottom) swapRedBlue(bottom, bottom, width);
           } else {
-            framebuffer[i + (height - 1 - j) * width] = pixel;
+            swapRedBlue(top, row.data(), width);
+            swapRedBlue(bottom, top, width);
+            std::memcpy(bottom, row.data(), rowSize);
           }
         }
+      } else {
+        for (int j = 0; j < height; j++) {
+          auto source = pixels + (topDown ? j : height - 1 - j) * row_padded;
+          auto destination = framebuffer + j * rowSize;
+          if (bytesPerPixel == 3)
+            swapRedBlue(source, destination, width);
+          else
+            convertBGRX(source, destination, width);
+        }
       }
-      input_file.close();
 
       return image;
     }
 
     void saveBMP(ppgso::Image &image, const std::string &bmp) {
-      auto width = image.width;
-      auto height = image.height;
-      auto &framebuffer = image.getFramebuffer();
+      saveBMP(image.view(), bmp);
+    }
+
+    void saveBMP(const ImageView<Image::Pixel> &view, const std::string &bmp) {
+      auto width = view.width;
+      auto height = view.height;
 
       unsigned int row_padded = (width * sizeof(Image::Pixel) + 3) & (~3);
 
@@ -124,7 +226,7 @@ namespace ppgso {
       bmpInfoHeader.biHeight = height;
       bmpInfoHeader.biPlanes = 1;
       bmpInfoHeader.biBitCount = 24;
-      bmpInfoHeader.biCompression = 0;
+      bmpInfoHeader.biCompression = BMP_RGB;
       bmpInfoHeader.biSizeImage = row_padded * height;
       bmpInfoHeader.biXPelsPerMeter = 2835;
       bmpInfoHeader.biYPelsPerMeter = 2835;
@@ -139,22 +241,14 @@ namespace ppgso {
         throw std::runtime_error(msg.str());
       }
 
-      output_file.write((char *) &bmpFileHeader, sizeof(BITMAPFILEHEADER));
-      output_file.write((char *) &bmpInfoHeader, sizeof(BITMAPINFOHEADER));
-
-      // Prepare BRG output data by swapping RGB to BRG and mirroring along height
-      output_file.seekp(bmpFileHeader.bfOffBits, output_file.beg);
-
-      for (int j = 0; j < height; j++) {
-        auto output_row = std::vector<Image::Pixel>(row_padded);
-        for (int i = 0; i < width; i++) {
-          auto pixel = framebuffer[i + (height - 1 - j) * width];
-          std::swap(pixel.r, pixel.b);
-          output_row[i] = pixel;
-        }
-        output_file.write((char *) output_row.data(), row_padded);
-      }
+      // Prepare the whole file, BGR rows are mirrored along height and padding stays zero
+      std::vector<uint8_t> file(bmpFileHeader.bfSize);
+      std::memcpy(file.data(), &bmpFileHeader, sizeof(BITMAPFILEHEADER));
+      std::memcpy(file.data() + sizeof(BITMAPFILEHEADER), &bmpInfoHeader, sizeof(BITMAPINFOHEADER));
+      for (int j = 0; j < height; j++)
+        swapRedBlue((const uint8_t *) view.row(height - 1 - j), &file[bmpFileHeader.bfOffBits + j * row_padded], width);
 
+      output_file.write((char *) file.data(), file.size());
       output_file.close();
     }
   }
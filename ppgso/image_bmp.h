@@ -4,7 +4,8 @@
 namespace ppgso {
 namespace image {
 /*!
- * Load BMP image from file. Only uncompressed RGB format is supported.
+ * Load BMP image from file. Only uncompressed 24 and 32 bit RGB formats are supported, rows may be stored
+ * bottom up or top down.
  *
  * @param bmp - File path to a BMP image.
  */
@@ -17,5 +18,12 @@ namespace image {
  */
   void saveBMP(ppgso::Image &image, const std::string &bmp);
 
+/*!
+ * Save part of an image as BMP image.
+ * @param view - Pixels to save, may be a crop or tile of a larger image.
+ * @param bmp - Name of the BMP file to save image to.
+ */
+  void saveBMP(const ImageView<ppgso::Image::Pixel> &view, const std::string &bmp);
+
 }
 }
@@ -0,0 +1,340 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "image.h"
+#include "image_view.h"
+
+namespace ppgso {
+
+  /*!
+   * IEEE 754 half precision float used as a 16 bit image channel, arithmetic is done after conversion to float.
+   */
+  struct half {
+    uint16_t bits;
+
+    half() = default;
+    explicit half(float value) : bits{fromFloat(value)} {}
+    explicit operator float() const { return toFloat(bits); }
+
+    /*!
+     * Convert float to half precision, rounds to nearest even and overflows to infinity.
+     *
+     * @param value - Value to convert.
+     * @return - Bits of the half precision value.
+     */
+    static uint16_t fromFloat(float value) {
+      uint32_t f;
+      std::memcpy(&f, &value, sizeof(f));
+      auto sign = (uint16_t) ((f >> 16) & 0x8000);
+      int exponent = (int) ((f >> 23) & 0xff);
+      uint32_t mantissa = f & 0x7fffff;
+
+      // Infinity and NaN
+      if (exponent == 0xff)
+        return (uint16_t) (sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+      exponent += 15 - 127;
+      if (exponent >= 31)
+        return (uint16_t) (sign | 0x7c00);
+
+      // Subnormal results shift the implicit bit into the mantissa
+      int shift = 13;
+      if (exponent <= 0) {
+        if (exponent < -10)
+          return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        exponent = 0;
+      }
+      uint32_t result = ((uint32_t) exponent << 10) | (mantissa >> shift);
+      uint32_t rest = mantissa & ((1u << shift) - 1);
+      uint32_t halfway = 1u << (shift - 1);
+      // A carry out of the mantissa correctly increments the exponent
+      if (rest > halfway || (rest == halfway && (result & 1)))
+        result++;
+      return (uint16_t) (sign | result);
+    }
+
+    /*!
+     * Convert half precision to float, the conversion is exact.
+     *
+     * @param bits - Bits of the half precision value.
+     * @return - Converted value.
+     */
+    static float toFloat(uint16_t bits) {
+      uint32_t sign = (uint32_t) (bits & 0x8000) << 16;
+      uint32_t exponent = (bits >> 10) & 0x1f;
+      uint32_t mantissa = bits & 0x3ff;
+      uint32_t f;
+      if (exponent == 0) {
+        float value = std::ldexp((float) mantissa, -24);
+        return sign ? -value : value;
+      } else if (exponent == 31) {
+        f = sign | 0x7f800000 | (mantissa << 13);
+      } else {
+        f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+      }
+      float value;
+      std::memcpy(&value, &f, sizeof(value));
+      return value;
+    }
+  };
+
+  /*!
+   * Conversion of a channel type to and from normalized float and 8 bit values.
+   * 8 bit channels map <0, 255> to <0, 1>, float channels are stored as is and clamped when converted to 8 bits.
+   */
+  template<typename T>
+  struct ChannelTraits;
+
+  template<>
+  struct ChannelTraits<uint8_t> {
+    static float toFloat(uint8_t value) { return value * (1.0f / 255.0f); }
+    static uint8_t fromFloat(float value) { return (uint8_t) (std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f); }
+    static uint8_t toByte(uint8_t value) { return value; }
+    static uint8_t fromByte(uint8_t value) { return value; }
+  };
+
+  template<>
+  struct ChannelTraits<float> {
+    static float toFloat(float value) { return value; }
+    static float fromFloat(float value) { return value; }
+    static uint8_t toByte(float value) { return ChannelTraits<uint8_t>::fromFloat(value); }
+    static float fromByte(uint8_t value) { return ChannelTraits<uint8_t>::toFloat(value); }
+  };
+
+  template<>
+  struct ChannelTraits<half> {
+    static float toFloat(half value) { return (float) value; }
+    static half fromFloat(float value) { return half{value}; }
+    static uint8_t toByte(half value) { return ChannelTraits<uint8_t>::fromFloat((float) value); }
+    static half fromByte(uint8_t value) { return half{ChannelTraits<uint8_t>::toFloat(value)}; }
+  };
+
+  /*!
+   * Image with a configurable pixel format, the storage is laid out for SIMD processing.
+   * Every row starts on a 64 byte boundary, rows are pitch bytes apart and the padding between rows is never read
+   * or written by the image itself. Channels of a pixel are interleaved.
+   *
+   * @tparam T - Channel type, uint8_t, float or half.
+   * @tparam Channels - Number of channels of a pixel, 1 and 2 hold luminance and alpha, 3 and 4 hold RGB and RGBA.
+   */
+  template<typename T, int Channels>
+  class ImageBuffer {
+  public:
+    static_assert(Channels >= 1 && Channels <= 4, "Images have 1 to 4 channels");
+
+    // Alignment of the rows in bytes
+    static const size_t ALIGNMENT = 64;
+
+    using Channel = T;
+    static const int CHANNELS = Channels;
+
+    struct Pixel {
+      T channels[Channels];
+
+      T &operator[](int i) { return channels[i]; }
+      const T &operator[](int i) const { return channels[i]; }
+    };
+
+    /*!
+     * Create new uninitialized image.
+     *
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @param pitch - Distance between rows in bytes, a multiple of ALIGNMENT. Zero uses the smallest possible pitch.
+     */
+    ImageBuffer(int width, int height, size_t pitch = 0) : width{width}, height{height}, pitch{pitch} {
+      size_t rowSize = (size_t) width * sizeof(Pixel);
+      if (this->pitch == 0)
+        this->pitch = (rowSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+      if (this->pitch < rowSize || this->pitch % ALIGNMENT != 0) {
+        std::stringstream msg;
+        msg << "Image pitch " << pitch << " is not a multiple of " << ALIGNMENT << " of at least " << rowSize << " bytes.";
+        throw std::runtime_error(msg.str());
+      }
+      allocate();
+    }
+
+    /*!
+     * Convert from the RGB8 Image, single and two channel images store the luminance and alpha is opaque.
+     *
+     * @param image - Image to convert.
+     */
+    explicit ImageBuffer(const Image &image) : ImageBuffer(image.width, image.height) {
+      auto &framebuffer = image.getFramebuffer();
+      for (int y = 0; y < height; y++) {
+        auto source = &framebuffer[(size_t) y * width];
+        auto destination = row(y);
+        for (int x = 0; x < width; x++) {
+          auto &pixel = source[x];
+          uint8_t luminance = (uint8_t) (0.299f * pixel.r + 0.587f * pixel.g + 0.114f * pixel.b + 0.5f);
+          uint8_t channels[4] = {pixel.r, pixel.g, pixel.b, 255};
+          if (Channels < 3) {
+            channels[0] = luminance;
+            channels[1] = 255;
+          }
+          for (int c = 0; c < Channels; c++)
+            destination[x][c] = ChannelTraits<T>::fromByte(channels[c]);
+        }
+      }
+    }
+
+    ImageBuffer(const ImageBuffer &other) : width{other.width}, height{other.height}, pitch{other.pitch} {
+      allocate();
+      if (pitch * height > 0)
+        std::memcpy(data, other.data, pitch * height);
+    }
+
+    /*!
+     * Take over the pixels of another buffer, the other buffer is left empty with no rows.
+     *
+     * @param other - Buffer to move from.
+     */
+    ImageBuffer(ImageBuffer &&other) noexcept : width{other.width}, height{other.height}, pitch{other.pitch},
+                                                storage{std::move(other.storage)}, data{other.data} {
+      other.width = 0;
+      other.height = 0;
+      other.pitch = 0;
+      other.data = nullptr;
+    }
+
+    ImageBuffer &operator=(ImageBuffer other) noexcept {
+      std::swap(width, other.width);
+      std::swap(height, other.height);
+      std::swap(pitch, other.pitch);
+      std::swap(storage, other.storage);
+      std::swap(data, other.data);
+      return *this;
+    }
+
+    /*!
+     * Convert to the RGB8 Image, single and two channel images are converted to gray and alpha is dropped.
+     *
+     * @return - Converted image.
+     */
+    Image toImage() const {
+      Image image{width, height};
+      auto &framebuffer = image.getFramebuffer();
+      const int green = Channels < 3 ? 0 : 1, blue = Channels < 3 ? 0 : 2;
+      for (int y = 0; y < height; y++) {
+        auto source = row(y);
+        auto destination = &framebuffer[(size_t) y * width];
+        for (int x = 0; x < width; x++) {
+          auto &pixel = source[x];
+          destination[x] = {ChannelTraits<T>::toByte(pixel[0]), ChannelTraits<T>::toByte(pixel[green]), ChannelTraits<T>::toByte(pixel[blue])};
+        }
+      }
+      return image;
+    }
+
+    /*!
+     * Get pointer to the first pixel of a row.
+     *
+     * @param y - Row index.
+     * @return - Pointer aligned to ALIGNMENT bytes.
+     */
+    Pixel *row(int y) {
+      return reinterpret_cast<Pixel*>(data + (size_t) y * pitch);
+    }
+
+    const Pixel *row(int y) const {
+      return reinterpret_cast<const Pixel*>(data + (size_t) y * pitch);
+    }
+
+    /*!
+     * Get writable view of all pixels.
+     *
+     * @return - Span of the whole image.
+     */
+    ImageSpan<Pixel> span() {
+      return {row(0), width, height, pitch};
+    }
+
+    /*!
+     * Get read only view of all pixels.
+     *
+     * @return - View of the whole image.
+     */
+    ImageView<Pixel> view() const {
+      return {row(0), width, height, pitch};
+    }
+
+    /*!
+     * Get single pixel of the image.
+     *
+     * @param x - X position of the pixel.
+     * @param y - Y position of the pixel.
+     * @return - Reference to the pixel.
+     */
+    Pixel &getPixel(int x, int y) {
+      return row(y)[x];
+    }
+
+    const Pixel &getPixel(int x, int y) const {
+      return row(y)[x];
+    }
+
+    /*!
+     * Set all pixels to a single value, the padding between rows is left untouched.
+     *
+     * @param value - Pixel value to set.
+     */
+    void fill(const Pixel &value) {
+      for (int y = 0; y < height; y++)
+        std::fill(row(y), row(y) + width, value);
+    }
+
+    /*!
+     * Get raw access to the image data.
+     *
+     * @return - Pointer to the first byte of the first row.
+     */
+    uint8_t *getData() {
+      return data;
+    }
+
+    const uint8_t *getData() const {
+      return data;
+    }
+
+    /*!
+     * Get distance between rows.
+     *
+     * @return - Pitch in bytes.
+     */
+    size_t getPitch() const {
+      return pitch;
+    }
+
+    int width, height;
+  private:
+    size_t pitch;
+    std::unique_ptr<uint8_t[]> storage;
+    uint8_t *data = nullptr;
+
+    /*!
+     * Allocate storage for all rows and align it.
+     */
+    void allocate() {
+      storage.reset(new uint8_t[pitch * height + ALIGNMENT - 1]);
+      auto address = reinterpret_cast<uintptr_t>(storage.get());
+      data = storage.get() + (ALIGNMENT - address % ALIGNMENT) % ALIGNMENT;
+    }
+  };
+
+  // Common image formats
+  using ImageR8 = ImageBuffer<uint8_t, 1>;
+  using ImageRGB8 = ImageBuffer<uint8_t, 3>;
+  using ImageRGBA8 = ImageBuffer<uint8_t, 4>;
+  using ImageR32F = ImageBuffer<float, 1>;
+  using ImageRGB32F = ImageBuffer<float, 3>;
+  using ImageRGBA32F = ImageBuffer<float, 4>;
+  using ImageRGBA16F = ImageBuffer<half, 4>;
+}
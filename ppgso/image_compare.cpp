@@ -0,0 +1,239 @@
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "image_compare.h"
+#include "image_buffer.h"
+#include "image_convolution.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPGSO_COMPARE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace ppgso {
+
+  // Number of rows of the SSIM statistics computed at once
+  const int SSIM_BAND_HEIGHT = 128;
+
+  // Stabilizing constants of SSIM for 8 bit values, (0.01 * 255)^2 and (0.03 * 255)^2
+  const double SSIM_C1 = 6.5025, SSIM_C2 = 58.5225;
+
+  /*!
+   * Differences of a single row.
+   */
+  struct RowDifference {
+    uint64_t pixels = 0, sum = 0, squares = 0;
+    int maxError = 0;
+  };
+
+  /*!
+   * Compare count pixels, the differences are added to the row.
+   */
+  static void compareScalar(const Image::Pixel *first, const Image::Pixel *second, int count, RowDifference &row) {
+    for (int x = 0; x < count; x++) {
+      int errors[3] = {std::abs(first[x].r - second[x].r), std::abs(first[x].g - second[x].g),
+                       std::abs(first[x].b - second[x].b)};
+      for (int error : errors) {
+        row.sum += (uint64_t) error;
+        row.squares += (uint64_t) (error * error);
+        row.maxError = std::max(row.maxError, error);
+      }
+      if (errors[0] | errors[1] | errors[2])
+        row.pixels++;
+    }
+  }
+
+#ifdef PPGSO_COMPARE_SSE2
+  /*!
+   * Count the set bits.
+   */
+  static int countBits(uint64_t bits) {
+    bits = bits - (bits >> 1 & 0x5555555555555555ull);
+    bits = (bits & 0x3333333333333333ull) + (bits >> 2 & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int) (bits * 0x0101010101010101ull >> 56);
+  }
+#endif
+
+  /*!
+   * Compare a row, 16 pixels in three vectors at a time.
+   */
+  static RowDifference compareRow(const Image::Pixel *first, const Image::Pixel *second, int width) {
+    RowDifference row;
+    int x = 0;
+#ifdef PPGSO_COMPARE_SSE2
+    auto a = reinterpret_cast<const uint8_t *>(first);
+    auto b = reinterpret_cast<const uint8_t *>(second);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i maximum = zero, sums = zero, squares = zero, wideSquares = zero;
+    // Bit 3 * i of a 48 bit mask is the first channel of pixel i
+    const uint64_t pixelBits = 0x249249249249ull;
+    int block = 0;
+    for (; x + 16 <= width; x += 16) {
+      uint64_t changed = 0;
+      for (int k = 0; k < 3; k++) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x * 3 + k * 16));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x * 3 + k * 16));
+        __m128i error = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        maximum = _mm_max_epu8(maximum, error);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(error, zero));
+        __m128i low = _mm_unpacklo_epi8(error, zero), high = _mm_unpackhi_epi8(error, zero);
+        squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+        changed |= (uint64_t) (~_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) & 0xffff) << (k * 16);
+      }
+      row.pixels += (uint64_t) countBits((changed | changed >> 1 | changed >> 2) & pixelBits);
+
+      // Squares of 256 blocks fit the 32 bit lanes, move them to 64 bit lanes before they overflow
+      if (++block == 256) {
+        wideSquares = _mm_add_epi64(wideSquares, _mm_add_epi64(_mm_unpacklo_epi32(squares, zero),
+                                                               _mm_unpackhi_epi32(squares, zero)));
+        squares = zero;
+        block = 0;
+      }
+    }
+    wideSquares = _mm_add_epi64(wideSquares, _mm_add_epi64(_mm_unpacklo_epi32(squares, zero),
+                                                           _mm_unpackhi_epi32(squares, zero)));
+
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+    row.sum = lanes[0] + lanes[1];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), wideSquares);
+    row.squares = lanes[0] + lanes[1];
+    uint8_t bytes[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes), maximum);
+    row.maxError = *std::max_element(bytes, bytes + 16);
+#endif
+    compareScalar(first + x, second + x, width - x, row);
+    return row;
+  }
+
+  /*!
+   * Check that two images have the same size.
+   */
+  template<typename First, typename Second>
+  static void checkSize(const ImageView<First> &first, const ImageView<Second> &second) {
+    if (first.width != second.width || first.height != second.height) {
+      std::stringstream msg;
+      msg << "Cannot compare " << first.width << "x" << first.height << " pixels with " << second.width << "x"
+          << second.height << " pixels.";
+      throw std::runtime_error(msg.str());
+    }
+  }
+
+  ImageDifference image::compare(const ImageView<Image::Pixel> &first, const ImageView<Image::Pixel> &second) {
+    checkSize(first, second);
+
+    // Rows are summed in order afterwards so the result does not depend on the number of threads
+    std::vector<RowDifference> rows((size_t) first.height);
+    #pragma omp parallel for
+    for (int y = 0; y < first.height; y++)
+      rows[y] = compareRow(first.row(y), second.row(y), first.width);
+
+    ImageDifference difference;
+    uint64_t sum = 0, squares = 0;
+    for (auto &row : rows) {
+      difference.pixels += row.pixels;
+      difference.maxError = std::max(difference.maxError, row.maxError);
+      sum += row.sum;
+      squares += row.squares;
+    }
+    double channels = 3.0 * first.width * first.height;
+    if (channels > 0) {
+      difference.meanError = (double) sum / channels;
+      difference.meanSquaredError = (double) squares / channels;
+    }
+    if (squares > 0)
+      difference.psnr = 10.0 * std::log10(255.0 * 255.0 / difference.meanSquaredError);
+    return difference;
+  }
+
+  double image::ssim(const ImageView<Image::Pixel> &first, const ImageView<Image::Pixel> &second) {
+    checkSize(first, second);
+    if (first.empty()) return 1.0;
+
+    // The statistics are blurred in bands that overlap by the reach of the window, so memory use stays small
+    auto window = ConvolutionKernel::gaussian(1.5f);
+    int reach = window.height / 2;
+    ImageRGB32F means{first.width, SSIM_BAND_HEIGHT + 2 * reach}, products{first.width, SSIM_BAND_HEIGHT + 2 * reach};
+    std::vector<double> rows((size_t) first.height);
+
+    for (int top = 0; top < first.height; top += SSIM_BAND_HEIGHT) {
+      int bottom = std::min(top + SSIM_BAND_HEIGHT, first.height);
+      int begin = std::max(top - reach, 0), end = std::min(bottom + reach, first.height);
+      auto meanSpan = means.span().crop(0, 0, first.width, end - begin);
+      auto productSpan = products.span().crop(0, 0, first.width, end - begin);
+
+      // Luminance of both images, their squares and product
+      #pragma omp parallel for
+      for (int y = begin; y < end; y++) {
+        auto a = first.row(y), b = second.row(y);
+        auto mean = meanSpan.row(y - begin), product = productSpan.row(y - begin);
+        for (int x = 0; x < first.width; x++) {
+          float u = .299f * a[x].r + .587f * a[x].g + .114f * a[x].b;
+          float v = .299f * b[x].r + .587f * b[x].g + .114f * b[x].b;
+          mean[x] = {{u, v, u * u}};
+          product[x] = {{v * v, u * v, 0.0f}};
+        }
+      }
+      window.apply(meanSpan, meanSpan);
+      window.apply(productSpan, productSpan);
+
+      #pragma omp parallel for
+      for (int y = top; y < bottom; y++) {
+        auto mean = meanSpan.row(y - begin), product = productSpan.row(y - begin);
+        double sum = 0.0;
+        for (int x = 0; x < first.width; x++) {
+          double mu1 = mean[x][0], mu2 = mean[x][1];
+          double sigma1 = mean[x][2] - mu1 * mu1, sigma2 = product[x][0] - mu2 * mu2;
+          double covariance = product[x][1] - mu1 * mu2;
+          sum += (2.0 * mu1 * mu2 + SSIM_C1) * (2.0 * covariance + SSIM_C2) /
+                 ((mu1 * mu1 + mu2 * mu2 + SSIM_C1) * (sigma1 + sigma2 + SSIM_C2));
+        }
+        rows[y] = sum;
+      }
+    }
+
+    double sum = 0.0;
+    for (auto row : rows)
+      sum += row;
+    return sum / ((double) first.width * first.height);
+  }
+
+  void image::heatmap(const ImageView<Image::Pixel> &first, const ImageView<Image::Pixel> &second,
+                      const ImageSpan<Image::Pixel> &destination, int range) {
+    checkSize(first, second);
+    checkSize(first, ImageView<Image::Pixel>{destination});
+    range = std::max(range, 1);
+
+    #pragma omp parallel for
+    for (int y = 0; y < first.height; y++) {
+      auto a = first.row(y), b = second.row(y);
+      auto output = destination.row(y);
+      for (int x = 0; x < first.width; x++) {
+        int error = std::max({std::abs(a[x].r - b[x].r), std::abs(a[x].g - b[x].g), std::abs(a[x].b - b[x].b)});
+        if (error == 0) {
+          auto gray = (uint8_t) ((a[x].r * 77 + a[x].g * 150 + a[x].b * 29) >> 10);
+          output[x] = {gray, gray, gray};
+          continue;
+        }
+        // Ramp in three thirds, blue rises, then blue turns into red, then green is added to get yellow
+        int t = std::min(error, range) * 765 / range;
+        if (t <= 255)
+          output[x] = {0, 0, (uint8_t) std::max(t, 64)};
+        else if (t <= 510)
+          output[x] = {(uint8_t) (t - 255), 0, (uint8_t) (510 - t)};
+        else
+          output[x] = {255, (uint8_t) (t - 510), 0};
+      }
+    }
+  }
+
+  Image image::heatmap(const ImageView<Image::Pixel> &first, const ImageView<Image::Pixel> &second, int range) {
+    Image result{first.width, first.height};
+    heatmap(first, second, result.span(), range);
+    return result;
+  }
+}
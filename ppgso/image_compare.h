@@ -0,0 +1,77 @@
+#pragma once
+#include <limits>
+
+#include "image.h"
+
+namespace ppgso {
+
+  /*!
+   * Differences of two images of the same size, channel differences are absolute values in range <0, 255>.
+   */
+  struct ImageDifference {
+    // Number of pixels that differ in at least one channel
+    size_t pixels = 0;
+    // Largest difference of a channel
+    int maxError = 0;
+    // Mean difference and mean squared difference of all channels
+    double meanError = 0.0, meanSquaredError = 0.0;
+    // Peak signal to noise ratio in dB, infinite for identical images
+    double psnr = std::numeric_limits<double>::infinity();
+
+    /*!
+     * Check if the images are the same.
+     *
+     * @return - True when no pixel differs.
+     */
+    bool identical() const {
+      return pixels == 0;
+    }
+  };
+
+  namespace image {
+
+/*!
+ * Compare two images pixel by pixel, rows are compared in parallel with SIMD inner loops.
+ *
+ * @param first - Pixels of the first image.
+ * @param second - Pixels of the second image, the same size as the first one.
+ * @return - Differences of the images.
+ */
+  ppgso::ImageDifference compare(const ImageView<ppgso::Image::Pixel> &first,
+                                 const ImageView<ppgso::Image::Pixel> &second);
+
+/*!
+ * Compute the mean structural similarity (SSIM) of the luminance of two images.
+ * Local statistics are weighted by a Gaussian window with sigma 1.5 and edges are clamped. The result is 1 for
+ * identical images and drops towards 0 as the structure of the images differs, unlike PSNR it tolerates small noise.
+ *
+ * @param first - Pixels of the first image.
+ * @param second - Pixels of the second image, the same size as the first one.
+ * @return - Mean SSIM of all pixels.
+ */
+  double ssim(const ImageView<ppgso::Image::Pixel> &first, const ImageView<ppgso::Image::Pixel> &second);
+
+/*!
+ * Visualize the differences of two images, each pixel shows the largest difference of its channels.
+ * Pixels that do not differ show the first image darkened, differences ramp from blue to red to yellow.
+ *
+ * @param first - Pixels of the first image.
+ * @param second - Pixels of the second image, the same size as the first one.
+ * @param destination - Pixels to write, the same size as the images.
+ * @param range - Difference shown as full yellow, larger differences are clamped.
+ */
+  void heatmap(const ImageView<ppgso::Image::Pixel> &first, const ImageView<ppgso::Image::Pixel> &second,
+               const ImageSpan<ppgso::Image::Pixel> &destination, int range = 32);
+
+/*!
+ * Visualize the differences of two images in a new image.
+ *
+ * @param first - Pixels of the first image.
+ * @param second - Pixels of the second image, the same size as the first one.
+ * @param range - Difference shown as full yellow, larger differences are clamped.
+ * @return - Heatmap of the differences.
+ */
+  ppgso::Image heatmap(const ImageView<ppgso::Image::Pixel> &first, const ImageView<ppgso::Image::Pixel> &second,
+                       int range = 32);
+  }
+}
@@ -0,0 +1,209 @@
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+
+#include "image_convert.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPGSO_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled for a single function and selected at runtime, this needs GCC or Clang function targets
+#if defined(PPGSO_CONVERT_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPGSO_CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+namespace ppgso {
+  namespace image {
+
+    // Elements of a dither pattern, one period of 12 values (4 pixels) plus the longest block of a kernel
+    const int PATTERN_PERIOD = 12;
+    const int PATTERN_SIZE = PATTERN_PERIOD + 32;
+
+    // Ordered dither thresholds of a 4x4 Bayer matrix
+    const int BAYER[4][4] = {
+      {0, 8, 2, 10},
+      {12, 4, 14, 6},
+      {3, 11, 1, 9},
+      {15, 7, 13, 5},
+    };
+
+    // Coefficients of the sRGB approximation, a combination of the square, fourth and eighth roots
+    const float SRGB_ROOT2 = 0.662002687f;
+    const float SRGB_ROOT4 = 0.684122060f;
+    const float SRGB_ROOT8 = -0.323583601f;
+    const float SRGB_LINEAR = -0.0225411470f;
+    const float SRGB_THRESHOLD = 0.0031308f;
+    const float SRGB_SLOPE = 12.92f;
+
+    /*!
+     * Convert a stream of float channels to bytes.
+     *
+     * @param source - Channels to convert.
+     * @param destination - Converted channels.
+     * @param count - Number of channels.
+     * @param pattern - Threshold added to each channel before truncation, repeats every PATTERN_PERIOD channels so a
+     *                  pointer into the first period starts the pattern at a later channel.
+     * @param srgb - True to apply the sRGB transfer function.
+     */
+    using Kernel = void (*)(const float *source, uint8_t *destination, size_t count, const float *pattern, bool srgb);
+
+    static uint8_t convertValue(float value, float threshold, bool srgb) {
+      // Written so NaN converts to zero like in the vector kernels
+      value = value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+      if (srgb) {
+        float root2 = std::sqrt(value), root4 = std::sqrt(root2), root8 = std::sqrt(root4);
+        value = value <= SRGB_THRESHOLD ? value * SRGB_SLOPE :
+                SRGB_ROOT2 * root2 + SRGB_ROOT4 * root4 + SRGB_ROOT8 * root8 + SRGB_LINEAR * value;
+      }
+      return (uint8_t) (value * 255.0f + threshold);
+    }
+
+    static void convertScalar(const float *source, uint8_t *destination, size_t count, const float *pattern, bool srgb) {
+      for (size_t i = 0; i < count; i++)
+        destination[i] = convertValue(source[i], pattern[i % PATTERN_PERIOD], srgb);
+    }
+
+#ifdef PPGSO_CONVERT_SSE2
+    static void convertSSE2(const float *source, uint8_t *destination, size_t count, const float *pattern, bool srgb) {
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16) {
+        auto thresholds = pattern + i % PATTERN_PERIOD;
+        __m128i values[4];
+        for (int k = 0; k < 4; k++) {
+          auto value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i + k * 4), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+          if (srgb) {
+            auto root2 = _mm_sqrt_ps(value), root4 = _mm_sqrt_ps(root2), root8 = _mm_sqrt_ps(root4);
+            auto curve = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(SRGB_ROOT2), root2),
+                                                          _mm_mul_ps(_mm_set1_ps(SRGB_ROOT4), root4)),
+                                               _mm_mul_ps(_mm_set1_ps(SRGB_ROOT8), root8)),
+                                    _mm_mul_ps(_mm_set1_ps(SRGB_LINEAR), value));
+            auto linear = _mm_cmple_ps(value, _mm_set1_ps(SRGB_THRESHOLD));
+            value = _mm_or_ps(_mm_and_ps(linear, _mm_mul_ps(value, _mm_set1_ps(SRGB_SLOPE))), _mm_andnot_ps(linear, curve));
+          }
+          value = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_loadu_ps(thresholds + k * 4));
+          values[k] = _mm_cvttps_epi32(value);
+        }
+        auto bytes = _mm_packus_epi16(_mm_packs_epi32(values[0], values[1]), _mm_packs_epi32(values[2], values[3]));
+        _mm_storeu_si128((__m128i *) (destination + i), bytes);
+      }
+      convertScalar(source + i, destination + i, count - i, pattern + i % PATTERN_PERIOD, srgb);
+    }
+#endif
+
+#ifdef PPGSO_CONVERT_AVX2
+    __attribute__((target("avx2")))
+    static void convertAVX2(const float *source, uint8_t *destination, size_t count, const float *pattern, bool srgb) {
+      size_t i = 0;
+      for (; i + 32 <= count; i += 32) {
+        auto thresholds = pattern + i % PATTERN_PERIOD;
+        __m256i values[4];
+        for (int k = 0; k < 4; k++) {
+          auto value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i + k * 8), _mm256_setzero_ps()),
+                                     _mm256_set1_ps(1.0f));
+          if (srgb) {
+            auto root2 = _mm256_sqrt_ps(value), root4 = _mm256_sqrt_ps(root2), root8 = _mm256_sqrt_ps(root4);
+            auto curve = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SRGB_ROOT2), root2),
+                                                                   _mm256_mul_ps(_mm256_set1_ps(SRGB_ROOT4), root4)),
+                                                     _mm256_mul_ps(_mm256_set1_ps(SRGB_ROOT8), root8)),
+                                       _mm256_mul_ps(_mm256_set1_ps(SRGB_LINEAR), value));
+            auto linear = _mm256_cmp_ps(value, _mm256_set1_ps(SRGB_THRESHOLD), _CMP_LE_OQ);
+            value = _mm256_blendv_ps(curve, _mm256_mul_ps(value, _mm256_set1_ps(SRGB_SLOPE)), linear);
+          }
+          value = _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(255.0f)), _mm256_loadu_ps(thresholds + k * 8));
+          values[k] = _mm256_cvttps_epi32(value);
+        }
+        // Packing works within 128 bit lanes, the permutation restores the order of the values
+        auto bytes = _mm256_packus_epi16(_mm256_packs_epi32(values[0], values[1]), _mm256_packs_epi32(values[2], values[3]));
+        bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *) (destination + i), bytes);
+      }
+      convertScalar(source + i, destination + i, count - i, pattern + i % PATTERN_PERIOD, srgb);
+    }
+#endif
+
+    /*!
+     * Select the fastest kernel supported by the CPU, the choice is made once.
+     *
+     * @param name - Receives the name of the kernel.
+     * @return - Selected kernel.
+     */
+    static Kernel selectKernel(const char **name = nullptr) {
+      static const struct Selection {
+        Kernel kernel;
+        const char *name;
+      } selection = [] {
+#ifdef PPGSO_CONVERT_AVX2
+        if (__builtin_cpu_supports("avx2"))
+          return Selection{convertAVX2, "AVX2"};
+#endif
+#ifdef PPGSO_CONVERT_SSE2
+        return Selection{convertSSE2, "SSE2"};
+#else
+        return Selection{convertScalar, "scalar"};
+#endif
+      }();
+      if (name) *name = selection.name;
+      return selection.kernel;
+    }
+
+    /*!
+     * Fill the thresholds of a row, the pattern starts at the first channel of the row.
+     *
+     * @param pattern - PATTERN_SIZE thresholds.
+     * @param flags - Combination of ConversionFlags.
+     * @param x - Horizontal position of the first pixel in the image.
+     * @param y - Vertical position of the row in the image.
+     */
+    static void fillPattern(float *pattern, int flags, int x, int y) {
+      for (int i = 0; i < PATTERN_SIZE; i++)
+        pattern[i] = flags & CONVERT_DITHER ? (BAYER[y & 3][(x + i / 3) & 3] + 0.5f) / 16.0f : 0.0f;
+    }
+
+    void convertRow(const float *source, Image::Pixel *destination, int width, int flags, int x, int y) {
+      float pattern[PATTERN_SIZE];
+      fillPattern(pattern, flags, x, y);
+      selectKernel()(source, (uint8_t *) destination, (size_t) width * 3, pattern, (flags & CONVERT_SRGB) != 0);
+    }
+
+    void convertRow(const float *red, const float *green, const float *blue, Image::Pixel *destination, int width,
+                    int flags, int x, int y) {
+      float pattern[PATTERN_SIZE];
+      fillPattern(pattern, flags, x, y);
+      auto kernel = selectKernel();
+
+      // Interleave blocks of pixels, blocks are a multiple of 4 pixels so each starts at the beginning of the pattern
+      const int BLOCK = 64;
+      float block[BLOCK * 3];
+      for (int start = 0; start < width; start += BLOCK) {
+        int count = std::min(BLOCK, width - start);
+        for (int i = 0; i < count; i++) {
+          block[i * 3] = red[start + i];
+          block[i * 3 + 1] = green[start + i];
+          block[i * 3 + 2] = blue[start + i];
+        }
+        kernel(block, (uint8_t *) (destination + start), (size_t) count * 3, pattern, (flags & CONVERT_SRGB) != 0);
+      }
+    }
+
+    void convert(const ImageView<ImageRGB32F::Pixel> &source, const ImageSpan<Image::Pixel> &destination, int flags) {
+      if (source.width != destination.width || source.height != destination.height) {
+        std::stringstream msg;
+        msg << "Can not convert " << source.width << "x" << source.height << " pixels to " << destination.width << "x"
+            << destination.height << " pixels.";
+        throw std::runtime_error(msg.str());
+      }
+      for (int y = 0; y < source.height; y++)
+        convertRow((const float *) source.row(y), destination.row(y), source.width, flags, destination.left,
+                   destination.top + y);
+    }
+
+    const char *conversionKernel() {
+      const char *name;
+      selectKernel(&name);
+      return name;
+    }
+  }
+}
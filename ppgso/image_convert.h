@@ -0,0 +1,66 @@
+#pragma once
+#include "image.h"
+#include "image_buffer.h"
+
+namespace ppgso {
+  namespace image {
+
+/*!
+ * Options of the conversion from float to 8 bit channels, flags can be combined.
+ * Linear conversion matches Image::setPixel, values are clamped to <0, 1> and scaled to <0, 255> without rounding.
+ * sRGB encoding approximates the sRGB transfer function within a quarter of an 8 bit step. Dithering adds an ordered
+ * 4x4 Bayer pattern before the value is truncated, the pattern is aligned to the image so tiles match at their borders.
+ */
+  enum ConversionFlags {
+    CONVERT_LINEAR = 0,
+    CONVERT_SRGB = 1,
+    CONVERT_DITHER = 2
+  };
+
+/*!
+ * Convert a row of interleaved float RGB values to 8 bit pixels.
+ *
+ * @param source - Pointer to 3 * width floats.
+ * @param destination - Pointer to width pixels.
+ * @param width - Number of pixels to convert.
+ * @param flags - Combination of ConversionFlags.
+ * @param x - Horizontal position of the first pixel in the image, aligns the dither pattern.
+ * @param y - Vertical position of the row in the image, aligns the dither pattern.
+ */
+  void convertRow(const float *source, ppgso::Image::Pixel *destination, int width, int flags = CONVERT_LINEAR,
+                  int x = 0, int y = 0);
+
+/*!
+ * Convert a row of planar float RGB values to 8 bit pixels.
+ *
+ * @param red - Pointer to width red values.
+ * @param green - Pointer to width green values.
+ * @param blue - Pointer to width blue values.
+ * @param destination - Pointer to width pixels.
+ * @param width - Number of pixels to convert.
+ * @param flags - Combination of ConversionFlags.
+ * @param x - Horizontal position of the first pixel in the image, aligns the dither pattern.
+ * @param y - Vertical position of the row in the image, aligns the dither pattern.
+ */
+  void convertRow(const float *red, const float *green, const float *blue, ppgso::Image::Pixel *destination, int width,
+                  int flags = CONVERT_LINEAR, int x = 0, int y = 0);
+
+/*!
+ * Convert a float image or a tile of it to 8 bit pixels, the views must have the same size.
+ * The position of the destination in its image aligns the dither pattern.
+ *
+ * @param source - Float pixels to convert.
+ * @param destination - Pixels to write.
+ * @param flags - Combination of ConversionFlags.
+ */
+  void convert(const ImageView<ppgso::ImageRGB32F::Pixel> &source, const ImageSpan<ppgso::Image::Pixel> &destination,
+               int flags = CONVERT_LINEAR);
+
+/*!
+ * Get the name of the conversion kernel selected for the CPU.
+ *
+ * @return - Name of the instruction set used, "AVX2", "SSE2" or "scalar".
+ */
+  const char *conversionKernel();
+  }
+}
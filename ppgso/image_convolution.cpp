@@ -0,0 +1,714 @@
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+#include "image_convolution.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPGSO_CONVOLUTION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace ppgso {
+
+  // Smallest number of rows blurred together by the running sums
+  const int BAND_HEIGHT = 256;
+
+  // Gaussian blurs with a smaller sigma use the exact kernel, it is faster than three boxes up to this size
+  const float BOX_SIGMA = 3.0f;
+
+  /*!
+   * Taps of a convolution pass, every tap multiplies the window at a position by a weight.
+   * Integer passes hold 16 bit fixed point weights in pairs, so two taps are multiplied and added by one instruction.
+   */
+  struct Pass {
+    // Position of the taps in the window, taps with zero weight are left out
+    std::vector<int> rows, columns;
+    std::vector<float> weights;
+    // Fixed point weights of two taps, the first in the low 16 bits, and the bits removed from the sums
+    std::vector<int32_t> pairs;
+    int shift = 0;
+
+    void add(int row, int column, float weight) {
+      if (weight == 0.0f) return;
+      rows.push_back(row);
+      columns.push_back(column);
+      weights.push_back(weight);
+    }
+
+    /*!
+     * Convert the weights to fixed point with the given number of bits.
+     */
+    void quantize(int bits) {
+      pairs.clear();
+      for (size_t k = 0; k < weights.size(); k += 2) {
+        auto first = (int16_t) std::lround(weights[k] * (float) (1 << bits));
+        auto second = (int16_t) (k + 1 < weights.size() ? std::lround(weights[k + 1] * (float) (1 << bits)) : 0);
+        pairs.push_back((int32_t) ((uint32_t) (uint16_t) first | (uint32_t) (uint16_t) second << 16));
+      }
+    }
+
+    /*!
+     * Get the number of fixed point bits of the weights so every weight fits 16 bits and a sum of values up to range
+     * fits 32 bits.
+     *
+     * @return - Number of bits, negative when the weights are too large.
+     */
+    int fixedPointBits(float range) const {
+      float largest = 0.0f, total = 0.0f;
+      for (auto weight : weights) {
+        largest = std::max(largest, std::fabs(weight));
+        total += std::fabs(weight);
+      }
+      int bits = 14;
+      while (bits >= 0 && (largest * (float) (1 << bits) > 32767.0f || total * (float) (1 << bits) * range > 1073741824.0f))
+        bits--;
+      return bits;
+    }
+  };
+
+  /*!
+   * Map position outside of the image to a position inside.
+   *
+   * @return - Position inside of the image or -1 for black pixels.
+   */
+  static int borderPosition(int position, int size, BorderMode border) {
+    if (position >= 0 && position < size) return position;
+    switch (border) {
+      case BorderMode::Clamp:
+        return position < 0 ? 0 : size - 1;
+      case BorderMode::Mirror: {
+        int period = 2 * size;
+        position %= period;
+        if (position < 0) position += period;
+        return position < size ? position : period - 1 - position;
+      }
+      case BorderMode::Wrap:
+        position %= size;
+        return position < 0 ? position + size : position;
+      case BorderMode::Zero:
+        break;
+    }
+    return -1;
+  }
+
+  static const uint8_t *channels(const Image::Pixel *pixels) {
+    return reinterpret_cast<const uint8_t *>(pixels);
+  }
+
+  static uint8_t *channels(Image::Pixel *pixels) {
+    return reinterpret_cast<uint8_t *>(pixels);
+  }
+
+  static const float *channels(const ImageRGB32F::Pixel *pixels) {
+    return reinterpret_cast<const float *>(pixels);
+  }
+
+  static float *channels(ImageRGB32F::Pixel *pixels) {
+    return reinterpret_cast<float *>(pixels);
+  }
+
+  /*!
+   * Convert channels to working values, 8 bit channels keep their range.
+   *
+   * @param source - Channels to convert.
+   * @param count - Number of channels.
+   * @param destination - Working values.
+   */
+  static void load(const uint8_t *source, int count, float *destination) {
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    auto zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+      auto data = _mm_loadu_si128((const __m128i *) (source + i));
+      auto low = _mm_unpacklo_epi8(data, zero), high = _mm_unpackhi_epi8(data, zero);
+      _mm_storeu_ps(destination + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)));
+      _mm_storeu_ps(destination + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)));
+      _mm_storeu_ps(destination + i + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)));
+      _mm_storeu_ps(destination + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)));
+    }
+#endif
+    for (; i < count; i++)
+      destination[i] = source[i];
+  }
+
+  static void load(const uint8_t *source, int count, int16_t *destination) {
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    auto zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+      auto data = _mm_loadu_si128((const __m128i *) (source + i));
+      _mm_storeu_si128((__m128i *) (destination + i), _mm_unpacklo_epi8(data, zero));
+      _mm_storeu_si128((__m128i *) (destination + i + 8), _mm_unpackhi_epi8(data, zero));
+    }
+#endif
+    for (; i < count; i++)
+      destination[i] = source[i];
+  }
+
+  static void load(const float *source, int count, float *destination) {
+    std::memcpy(destination, source, count * sizeof(float));
+  }
+
+  /*!
+   * Convert working values to channels, 8 bit channels are rounded and saturated.
+   *
+   * @param source - Working values.
+   * @param count - Number of channels.
+   * @param bias - Value added after scaling.
+   * @param destination - Channels to write.
+   * @param scale - Factor the values are multiplied with.
+   */
+  static void store(const float *source, int count, float bias, uint8_t *destination, float scale = 1.0f) {
+    bias += 0.5f;
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    auto scales = _mm_set1_ps(scale), biases = _mm_set1_ps(bias);
+    auto zero = _mm_setzero_ps(), maximum = _mm_set1_ps(255.0f);
+    for (; i + 16 <= count; i += 16) {
+      __m128i integers[4];
+      for (int k = 0; k < 4; k++) {
+        auto value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 4 * k), scales), biases);
+        integers[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, zero), maximum));
+      }
+      auto bytes = _mm_packus_epi16(_mm_packs_epi32(integers[0], integers[1]), _mm_packs_epi32(integers[2], integers[3]));
+      _mm_storeu_si128((__m128i *) (destination + i), bytes);
+    }
+#endif
+    for (; i < count; i++) {
+      float value = source[i] * scale + bias;
+      destination[i] = !(value > 0.0f) ? 0 : value >= 255.0f ? 255 : (uint8_t) value;
+    }
+  }
+
+  static void store(const float *source, int count, float bias, float *destination, float scale = 1.0f) {
+    for (int i = 0; i < count; i++)
+      destination[i] = source[i] * scale + bias;
+  }
+
+  static void store(const int16_t *source, int count, float bias, uint8_t *destination) {
+    auto offset = (int16_t) std::lround(std::min(std::max(bias, -32768.0f), 32767.0f));
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    auto offsets = _mm_set1_epi16(offset);
+    for (; i + 16 <= count; i += 16) {
+      auto low = _mm_adds_epi16(_mm_loadu_si128((const __m128i *) (source + i)), offsets);
+      auto high = _mm_adds_epi16(_mm_loadu_si128((const __m128i *) (source + i + 8)), offsets);
+      _mm_storeu_si128((__m128i *) (destination + i), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; i < count; i++)
+      destination[i] = (uint8_t) std::min(std::max(source[i] + offset, 0), 255);
+  }
+
+  /*!
+   * Weighted sum of rows of working values, value i of the result is the sum of the weights times value i of the taps.
+   *
+   * @param pass - Weights of the taps.
+   * @param taps - Rows of the taps, integer passes need an even number of rows.
+   * @param count - Number of values.
+   * @param result - Row of the sums.
+   */
+  static void weightedSum(const Pass &pass, const float *const *taps, int count, float *result) {
+    int size = (int) pass.weights.size();
+    auto weights = pass.weights.data();
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    for (; i + 8 <= count; i += 8) {
+      auto low = _mm_setzero_ps(), high = _mm_setzero_ps();
+      for (int k = 0; k < size; k++) {
+        auto weight = _mm_set1_ps(weights[k]);
+        low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(taps[k] + i), weight));
+        high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(taps[k] + i + 4), weight));
+      }
+      _mm_storeu_ps(result + i, low);
+      _mm_storeu_ps(result + i + 4, high);
+    }
+#endif
+    for (; i < count; i++) {
+      float sum = 0.0f;
+      for (int k = 0; k < size; k++)
+        sum += taps[k][i] * weights[k];
+      result[i] = sum;
+    }
+  }
+
+  static void weightedSum(const Pass &pass, const int16_t *const *taps, int count, int16_t *result) {
+    int size = (int) pass.pairs.size();
+    auto pairs = pass.pairs.data();
+    int32_t rounding = pass.shift > 0 ? 1 << (pass.shift - 1) : 0;
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    auto roundings = _mm_set1_epi32(rounding);
+    auto shift = _mm_cvtsi32_si128(pass.shift);
+    for (; i + 8 <= count; i += 8) {
+      auto low = roundings, high = roundings;
+      for (int k = 0; k < size; k++) {
+        // Interleave values of both taps so each 32 bit product sum takes one value from each
+        auto first = _mm_loadu_si128((const __m128i *) (taps[2 * k] + i));
+        auto second = _mm_loadu_si128((const __m128i *) (taps[2 * k + 1] + i));
+        auto weight = _mm_set1_epi32(pairs[k]);
+        low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(first, second), weight));
+        high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(first, second), weight));
+      }
+      auto sums = _mm_packs_epi32(_mm_sra_epi32(low, shift), _mm_sra_epi32(high, shift));
+      _mm_storeu_si128((__m128i *) (result + i), sums);
+    }
+#endif
+    for (; i < count; i++) {
+      int32_t sum = rounding;
+      for (int k = 0; k < size; k++)
+        sum += taps[2 * k][i] * (int16_t) (pairs[k] & 0xffff) + taps[2 * k + 1][i] * (int16_t) ((uint32_t) pairs[k] >> 16);
+      result[i] = (int16_t) std::min(std::max(sum >> pass.shift, -32768), 32767);
+    }
+  }
+
+  /*!
+   * Copy a window of the source to working values, positions outside of the source are handled by the border mode.
+   *
+   * @param source - Pixels of the image.
+   * @param left - Horizontal position of the window, may be outside of the image.
+   * @param top - Vertical position of the window, may be outside of the image.
+   * @param width - Width of the window in pixels.
+   * @param height - Height of the window in pixels.
+   * @param border - Pixels read outside of the source.
+   * @param window - Working values of width * height pixels.
+   */
+  template<typename Source, typename Work>
+  static void gather(const ImageView<Source> &source, int left, int top, int width, int height, BorderMode border,
+                     Work *window) {
+    int begin = std::max(left, 0), end = std::min(left + width, source.width);
+    for (int y = 0; y < height; y++) {
+      Work *row = window + (size_t) y * width * 3;
+      int sourceY = borderPosition(top + y, source.height, border);
+      if (sourceY < 0) {
+        std::fill(row, row + width * 3, Work{});
+        continue;
+      }
+      auto pixels = channels(source.row(sourceY));
+      load(pixels + begin * 3, (end - begin) * 3, row + (begin - left) * 3);
+
+      // Pixels left and right of the image
+      auto outside = [&](int x) {
+        int sourceX = borderPosition(x, source.width, border);
+        for (int c = 0; c < 3; c++)
+          row[(x - left) * 3 + c] = sourceX < 0 ? Work{} : (Work) pixels[sourceX * 3 + c];
+      };
+      for (int x = left; x < begin; x++)
+        outside(x);
+      for (int x = end; x < left + width; x++)
+        outside(x);
+    }
+  }
+
+  /*!
+   * Check if two views share any bytes.
+   */
+  template<typename P, typename Q>
+  static bool overlaps(const ImageView<P> &first, const ImageSpan<Q> &second) {
+    if (first.empty() || second.empty()) return false;
+    auto firstBegin = reinterpret_cast<uintptr_t>(first.data);
+    auto firstEnd = reinterpret_cast<uintptr_t>(first.row(first.height - 1) + first.width);
+    auto secondBegin = reinterpret_cast<uintptr_t>(second.data);
+    auto secondEnd = reinterpret_cast<uintptr_t>(second.row(second.height - 1) + second.width);
+    return firstBegin < secondEnd && secondBegin < firstEnd;
+  }
+
+  template<typename P, typename Q>
+  static void checkSize(const ImageView<P> &source, const ImageSpan<Q> &destination) {
+    if (source.width != destination.width || source.height != destination.height) {
+      std::stringstream msg;
+      msg << "Cannot filter " << source.width << "x" << source.height << " pixels into " << destination.width << "x"
+          << destination.height << " pixels.";
+      throw std::runtime_error(msg.str());
+    }
+  }
+
+  /*!
+   * Get source that does not share pixels with the destination, overlapping sources are copied.
+   *
+   * @param source - Pixels to filter.
+   * @param destination - Pixels to write.
+   * @param copy - Storage of the copy.
+   * @return - Source or view of the copy.
+   */
+  template<typename Source, typename Destination>
+  static ImageView<Source> separate(const ImageView<Source> &source, const ImageSpan<Destination> &destination,
+                                    std::vector<Source> &copy) {
+    if (!overlaps(source, destination)) return source;
+    copy.resize((size_t) source.width * source.height);
+    for (int y = 0; y < source.height; y++)
+      std::copy(source.row(y), source.row(y) + source.width, &copy[(size_t) y * source.width]);
+    return {copy.data(), source.width, source.height, source.width * sizeof(Source)};
+  }
+
+  ConvolutionKernel::ConvolutionKernel(const std::vector<float> &weights, int size, float factor, float bias)
+      : width{size}, height{size}, bias{bias} {
+    if (size < 1 || size % 2 == 0 || weights.size() != (size_t) size * size) {
+      std::stringstream msg;
+      msg << "Convolution kernel of size " << size << " needs an odd size and " << size << "^2 weights, got "
+          << weights.size() << ".";
+      throw std::runtime_error(msg.str());
+    }
+    if (factor == 0.0f)
+      throw std::runtime_error("Convolution kernel factor must not be zero.");
+    for (auto weight : weights)
+      matrix.push_back(weight / factor);
+
+    // The matrix is separable when every weight is the product of the weights in its row and column of the largest one
+    auto largest = std::max_element(matrix.begin(), matrix.end(),
+                                    [](float a, float b) { return std::fabs(a) < std::fabs(b); });
+    if (*largest == 0.0f) return;
+    int pivot = (int) (largest - matrix.begin());
+    std::vector<float> row(size), column(size);
+    for (int i = 0; i < size; i++) {
+      row[i] = matrix[pivot / size * size + i] / *largest;
+      column[i] = matrix[i * size + pivot % size];
+    }
+    float tolerance = std::fabs(*largest) * 1e-6f;
+    for (int y = 0; y < size; y++)
+      for (int x = 0; x < size; x++)
+        if (std::fabs(column[y] * row[x] - matrix[y * size + x]) > tolerance) return;
+    horizontal = row;
+    vertical = column;
+    matrix.clear();
+  }
+
+  ConvolutionKernel ConvolutionKernel::separable(const std::vector<float> &horizontal,
+                                                 const std::vector<float> &vertical, float factor, float bias) {
+    if (horizontal.size() % 2 == 0 || vertical.size() % 2 == 0) {
+      std::stringstream msg;
+      msg << "Separable convolution kernel of " << horizontal.size() << "x" << vertical.size()
+          << " weights needs an odd number of them.";
+      throw std::runtime_error(msg.str());
+    }
+    if (factor == 0.0f)
+      throw std::runtime_error("Convolution kernel factor must not be zero.");
+    ConvolutionKernel kernel;
+    kernel.width = (int) horizontal.size();
+    kernel.height = (int) vertical.size();
+    kernel.bias = bias;
+    kernel.horizontal = horizontal;
+    for (auto weight : vertical)
+      kernel.vertical.push_back(weight / factor);
+    return kernel;
+  }
+
+  ConvolutionKernel ConvolutionKernel::gaussian(float sigma) {
+    if (!(sigma > 0.0f)) {
+      std::stringstream msg;
+      msg << "Gaussian kernel needs a positive sigma, got " << sigma << ".";
+      throw std::runtime_error(msg.str());
+    }
+    int radius = std::max(1, (int) std::ceil(3.0f * sigma));
+    std::vector<float> weights;
+    float total = 0.0f;
+    for (int i = -radius; i <= radius; i++) {
+      weights.push_back(std::exp(-(float) (i * i) / (2.0f * sigma * sigma)));
+      total += weights.back();
+    }
+    for (auto &weight : weights)
+      weight /= total;
+    return separable(weights, weights);
+  }
+
+  template<typename Work, typename Source, typename Destination>
+  bool ConvolutionKernel::convolve(const ImageView<Source> &source, const ImageSpan<Destination> &destination,
+                                   BorderMode border, float range) const {
+    checkSize(source, destination);
+    if (source.empty()) return true;
+    int radiusX = width / 2, radiusY = height / 2;
+
+    // Separable kernels convolve rows of the window first and then the columns of the result
+    Pass first, second;
+    if (isSeparable()) {
+      for (int k = 0; k < width; k++)
+        first.add(0, k, horizontal[k]);
+      for (int k = 0; k < height; k++)
+        second.add(k, 0, vertical[k]);
+    } else {
+      for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+          first.add(y, x, matrix[y * width + x]);
+    }
+
+    if (std::is_same<Work, int16_t>::value) {
+      int bits = first.fixedPointBits(range);
+      if (bits < 0) return false;
+      if (isSeparable()) {
+        // Keep fraction bits in the rows between the passes as long as the sums fit 16 bits
+        float total = 0.0f;
+        for (auto weight : first.weights)
+          total += std::fabs(weight);
+        int fraction = total > 0.0f ? (int) std::floor(std::log2(32767.0f / (range * total))) : 0;
+        fraction = std::min(std::max(fraction, 0), std::min(bits, 7));
+        int secondBits = second.fixedPointBits(32767.0f);
+        if (secondBits < 0) return false;
+        first.shift = bits - fraction;
+        second.quantize(secondBits);
+        second.shift = secondBits + fraction;
+      } else {
+        first.shift = bits;
+      }
+      first.quantize(bits);
+    }
+    auto &last = isSeparable() ? second : first;
+
+    std::vector<Source> copy;
+    auto input = separate(source, destination, copy);
+
+    int tilesX = (input.width + TILE_WIDTH - 1) / TILE_WIDTH, tilesY = (input.height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    int tapCount = (int) std::max(first.weights.size(), second.weights.size());
+    float offset = bias * range;
+
+    #pragma omp parallel
+    {
+      // Window of a tile extended by the radius, the window after the horizontal pass and one row of the result
+      std::vector<Work> window((size_t) (TILE_WIDTH + 2 * radiusX) * (TILE_HEIGHT + 2 * radiusY) * 3);
+      std::vector<Work> rows(isSeparable() ? (size_t) TILE_WIDTH * (TILE_HEIGHT + 2 * radiusY) * 3 : 0);
+      std::vector<Work> result((size_t) TILE_WIDTH * 3);
+      // Integer sums take taps in pairs, an odd tap is paired with a copy of the first one with zero weight
+      std::vector<const Work *> taps(tapCount + 1);
+
+      auto sumTaps = [&](const Pass &pass, const Work *data, size_t stride, int count, Work *sums) {
+        int size = (int) pass.weights.size();
+        for (int k = 0; k < size; k++)
+          taps[k] = data + pass.rows[k] * stride + pass.columns[k] * 3;
+        if (size % 2) taps[size] = taps[0];
+        weightedSum(pass, taps.data(), count, sums);
+      };
+
+      #pragma omp for schedule(dynamic)
+      for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        int left = tile % tilesX * TILE_WIDTH, top = tile / tilesX * TILE_HEIGHT;
+        int tileWidth = std::min((int) TILE_WIDTH, input.width - left);
+        int tileHeight = std::min((int) TILE_HEIGHT, input.height - top);
+        int windowWidth = tileWidth + 2 * radiusX, windowHeight = tileHeight + 2 * radiusY;
+        gather(input, left - radiusX, top - radiusY, windowWidth, windowHeight, border, window.data());
+
+        int count = tileWidth * 3;
+        const Work *data = window.data();
+        size_t stride = (size_t) windowWidth * 3;
+        if (isSeparable()) {
+          for (int y = 0; y < windowHeight; y++)
+            sumTaps(first, data + y * stride, stride, count, &rows[(size_t) y * count]);
+          data = rows.data();
+          stride = (size_t) count;
+        }
+        for (int y = 0; y < tileHeight; y++) {
+          sumTaps(last, data + y * stride, stride, count, result.data());
+          store(result.data(), count, offset, channels(destination.row(top + y) + left));
+        }
+      }
+    }
+    return true;
+  }
+
+  void ConvolutionKernel::apply(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination,
+                                BorderMode border, ConvolutionMode mode) const {
+    // Kernels with weights too large for 16 bit fixed point are convolved in float
+    if (mode == ConvolutionMode::Float || !convolve<int16_t>(source, destination, border, 255.0f))
+      convolve<float>(source, destination, border, 255.0f);
+  }
+
+  void ConvolutionKernel::apply(const ImageView<ImageRGB32F::Pixel> &source,
+                                const ImageSpan<ImageRGB32F::Pixel> &destination, BorderMode border) const {
+    convolve<float>(source, destination, border, 1.0f);
+  }
+
+  /*!
+   * Sum boxes of 2 * radius + 1 pixels along a row of interleaved values.
+   *
+   * @param source - Row of count + 2 * radius pixels.
+   * @param count - Number of sums in pixels.
+   * @param radius - Radius of the box.
+   * @param sums - Row of count pixels.
+   */
+  static void slideRow(const float *source, int count, int radius, float *sums) {
+    // Each channel has its own sum, the next sum adds the pixel entering the box and removes the one leaving it
+    float total[3] = {};
+    int size = 2 * radius + 1;
+    for (int x = 0; x < size; x++)
+      for (int c = 0; c < 3; c++)
+        total[c] += source[x * 3 + c];
+    for (int x = 0; x < count; x++) {
+      for (int c = 0; c < 3; c++) {
+        sums[x * 3 + c] = total[c];
+        if (x + 1 < count)
+          total[c] += source[(x + size) * 3 + c] - source[x * 3 + c];
+      }
+    }
+  }
+
+  /*!
+   * Add the difference of two rows to the sums, the rows entering and leaving the box.
+   */
+  static void slideSums(float *sums, const float *entering, const float *leaving, int count) {
+    int i = 0;
+#ifdef PPGSO_CONVOLUTION_SSE2
+    for (; i + 4 <= count; i += 4) {
+      auto difference = _mm_sub_ps(_mm_loadu_ps(entering + i), _mm_loadu_ps(leaving + i));
+      _mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(sums + i), difference));
+    }
+#endif
+    for (; i < count; i++)
+      sums[i] += entering[i] - leaving[i];
+  }
+
+  /*!
+   * Running sums of a box over rows pushed from the top, the last 2 * radius + 1 rows are kept in a ring.
+   */
+  struct BoxRows {
+    int radius, count, received = 0;
+    std::vector<float> ring, total;
+
+    BoxRows(int radius, int count) : radius{radius}, count{count}, ring((size_t) (2 * radius + 1) * count),
+                                     total((size_t) count) {}
+
+    void reset() {
+      received = 0;
+      std::fill(total.begin(), total.end(), 0.0f);
+    }
+
+    /*!
+     * Push next row.
+     *
+     * @param row - Values of the row.
+     * @return - Sums of the box ending with the row or nullptr until the box is full.
+     */
+    const float *push(const float *row) {
+      int size = 2 * radius + 1;
+      float *slot = &ring[(size_t) (received % size) * count];
+      if (received < size) {
+        for (int i = 0; i < count; i++)
+          total[i] += row[i];
+      } else {
+        slideSums(total.data(), row, slot, count);
+      }
+      std::memcpy(slot, row, count * sizeof(float));
+      received++;
+      return received >= size ? total.data() : nullptr;
+    }
+  };
+
+  /*!
+   * Blur with a sequence of boxes using running sums.
+   * The image is processed in bands of rows, every source row is extended by the border, summed along the row by each box
+   * and pushed through the running sums of the boxes down the columns. Sums are scaled once at the end, sums of 8 bit
+   * channels are exact as long as they fit the 24 bits of the float mantissa.
+   */
+  template<typename Source, typename Destination>
+  static void blurBoxes(const ImageView<Source> &source, const ImageSpan<Destination> &destination,
+                        const std::vector<int> &radii, BorderMode border) {
+    checkSize(source, destination);
+    if (source.empty()) return;
+    std::vector<Source> copy;
+    auto input = separate(source, destination, copy);
+    int width = input.width, height = input.height, count = width * 3;
+
+    // Rows above and below a band that reach into it, bands are high enough to keep this overhead low
+    int reach = 0;
+    float scale = 1.0f;
+    for (auto radius : radii) {
+      reach += radius;
+      scale /= (float) (2 * radius + 1) * (float) (2 * radius + 1);
+    }
+    int bandHeight = std::max(BAND_HEIGHT, 4 * reach);
+    int bands = (height + bandHeight - 1) / bandHeight;
+
+    #pragma omp parallel
+    {
+      std::vector<float> first((size_t) (width + 2 * reach) * 3), second(first.size());
+      std::vector<BoxRows> boxes;
+      for (auto radius : radii)
+        boxes.emplace_back(radius, count);
+
+      #pragma omp for schedule(dynamic)
+      for (int band = 0; band < bands; band++) {
+        int top = band * bandHeight, bottom = std::min(top + bandHeight, height);
+        for (auto &box : boxes)
+          box.reset();
+        int y = top;
+        for (int sourceY = top - reach; sourceY < bottom + reach; sourceY++) {
+          // Each box shortens the extended row by its radius on both sides
+          gather(input, -reach, sourceY, width + 2 * reach, 1, border, first.data());
+          int extended = reach;
+          const float *row = first.data();
+          for (auto radius : radii) {
+            extended -= radius;
+            float *sums = row == first.data() ? second.data() : first.data();
+            slideRow(row, width + 2 * extended, radius, sums);
+            row = sums;
+          }
+          for (auto &box : boxes) {
+            row = box.push(row);
+            if (!row) break;
+          }
+          if (row)
+            store(row, count, 0.0f, channels(destination.row(y++)), scale);
+        }
+      }
+    }
+  }
+
+  /*!
+   * Get radii of three boxes that blur like a Gaussian, the widths are odd numbers around the ideal width and the number
+   * of narrower boxes is chosen to match the variance.
+   */
+  static std::vector<int> gaussianBoxes(float sigma) {
+    if (!(sigma > 0.0f)) {
+      std::stringstream msg;
+      msg << "Gaussian blur needs a positive sigma, got " << sigma << ".";
+      throw std::runtime_error(msg.str());
+    }
+    const int count = 3;
+    float variance = 12.0f * sigma * sigma;
+    auto lower = (int) std::sqrt(variance / count + 1.0f);
+    if (lower % 2 == 0) lower--;
+    auto narrower = (int) std::lround((variance - count * lower * lower - 4.0f * count * lower - 3.0f * count) /
+                                      (-4.0f * lower - 4.0f));
+    std::vector<int> radii;
+    for (int i = 0; i < count; i++)
+      radii.push_back(i < narrower ? (lower - 1) / 2 : (lower + 1) / 2);
+    return radii;
+  }
+
+  static std::vector<int> box(int radius) {
+    if (radius < 0) {
+      std::stringstream msg;
+      msg << "Box blur needs a radius of at least 0, got " << radius << ".";
+      throw std::runtime_error(msg.str());
+    }
+    return {radius};
+  }
+
+  void image::boxBlur(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination, int radius,
+                      BorderMode border) {
+    blurBoxes(source, destination, box(radius), border);
+  }
+
+  void image::boxBlur(const ImageView<ImageRGB32F::Pixel> &source, const ImageSpan<ImageRGB32F::Pixel> &destination,
+                      int radius, BorderMode border) {
+    blurBoxes(source, destination, box(radius), border);
+  }
+
+  void image::gaussianBlur(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination,
+                           float sigma, BorderMode border) {
+    if (sigma < BOX_SIGMA)
+      ConvolutionKernel::gaussian(sigma).apply(source, destination, border);
+    else
+      blurBoxes(source, destination, gaussianBoxes(sigma), border);
+  }
+
+  void image::gaussianBlur(const ImageView<ImageRGB32F::Pixel> &source,
+                           const ImageSpan<ImageRGB32F::Pixel> &destination, float sigma, BorderMode border) {
+    if (sigma < BOX_SIGMA)
+      ConvolutionKernel::gaussian(sigma).apply(source, destination, border);
+    else
+      blurBoxes(source, destination, gaussianBoxes(sigma), border);
+  }
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <vector>
+
+#include "image.h"
+#include "image_buffer.h"
+
+namespace ppgso {
+
+  /*!
+   * Pixels read by a convolution outside of the image.
+   */
+  enum class BorderMode {
+    // Repeat the edge pixels
+    Clamp,
+    // Reflect the image at its edges, the edge pixels are repeated like with GL_MIRRORED_REPEAT
+    Mirror,
+    // Tile the image like GL_REPEAT, this is what the Texture sampler of convolution_frag.glsl does
+    Wrap,
+    // Read black pixels
+    Zero
+  };
+
+  /*!
+   * Arithmetic used to convolve 8 bit images.
+   * Integer mode uses 16 bit fixed point weights and saturates intermediate results to 16 bits, float mode computes in
+   * single precision and suits kernels with large weights. Float images are always convolved in float.
+   */
+  enum class ConvolutionMode {
+    Integer,
+    Float
+  };
+
+  /*!
+   * Convolution kernel with odd width and height, the result is the weighted sum of the pixels under the kernel divided
+   * by the factor plus the bias, like in shader/convolution_frag.glsl. Weights are stored row major with the first row
+   * on top of the image, note that the shader indexes its array by the horizontal offset first.
+   *
+   * Kernels that are a product of a horizontal and a vertical vector are applied in two 1D passes. The image is processed
+   * in tiles that fit into the cache, the tiles are convolved in parallel with SIMD inner loops.
+   */
+  class ConvolutionKernel {
+  public:
+    // Size of the tiles in pixels
+    static const int TILE_WIDTH = 128;
+    static const int TILE_HEIGHT = 64;
+
+    /*!
+     * Create kernel from a square matrix, separable matrices are detected and split into vectors.
+     *
+     * @param weights - size * size weights in row major order.
+     * @param size - Width and height of the kernel, odd.
+     * @param factor - Divisor of the weighted sum.
+     * @param bias - Value added to the result, 1 is full intensity like in the shader.
+     */
+    ConvolutionKernel(const std::vector<float> &weights, int size, float factor = 1.0f, float bias = 0.0f);
+
+    /*!
+     * Create kernel that is a product of two vectors, the weight of offset x, y is horizontal[x] * vertical[y].
+     *
+     * @param horizontal - Weights of the row, odd number of them.
+     * @param vertical - Weights of the column, odd number of them.
+     * @param factor - Divisor of the weighted sum.
+     * @param bias - Value added to the result, 1 is full intensity like in the shader.
+     * @return - Separable kernel.
+     */
+    static ConvolutionKernel separable(const std::vector<float> &horizontal, const std::vector<float> &vertical,
+                                       float factor = 1.0f, float bias = 0.0f);
+
+    /*!
+     * Create normalized Gaussian kernel reaching three standard deviations from the center.
+     *
+     * @param sigma - Standard deviation in pixels.
+     * @return - Separable kernel.
+     */
+    static ConvolutionKernel gaussian(float sigma);
+
+    /*!
+     * Convolve an 8 bit image, the views must have the same size.
+     * Pixels outside of the source view are never read, even when it is a crop of a larger image, the border mode
+     * supplies them. Source and destination may be the same image.
+     *
+     * @param source - Pixels to convolve.
+     * @param destination - Pixels to write.
+     * @param border - Pixels read outside of the source.
+     * @param mode - Arithmetic of the convolution.
+     */
+    void apply(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination,
+               BorderMode border = BorderMode::Clamp, ConvolutionMode mode = ConvolutionMode::Integer) const;
+
+    /*!
+     * Convolve a float image, the views must have the same size. Results are not clamped.
+     *
+     * @param source - Pixels to convolve.
+     * @param destination - Pixels to write.
+     * @param border - Pixels read outside of the source.
+     */
+    void apply(const ImageView<ImageRGB32F::Pixel> &source, const ImageSpan<ImageRGB32F::Pixel> &destination,
+               BorderMode border = BorderMode::Clamp) const;
+
+    /*!
+     * Check if the kernel is applied in two 1D passes.
+     *
+     * @return - True for separable kernels.
+     */
+    bool isSeparable() const {
+      return !horizontal.empty();
+    }
+
+    int width = 0, height = 0;
+  private:
+    ConvolutionKernel() = default;
+
+    // Weights divided by the factor, a separable kernel stores the vectors and other kernels the matrix
+    std::vector<float> matrix, horizontal, vertical;
+    float bias = 0.0f;
+
+    /*!
+     * Convolve with working values of type Work, 16 bit integers or float.
+     *
+     * @param range - Largest channel value of the source, scales the bias.
+     * @return - False when the weights do not fit 16 bit fixed point.
+     */
+    template<typename Work, typename Source, typename Destination>
+    bool convolve(const ImageView<Source> &source, const ImageSpan<Destination> &destination, BorderMode border,
+                  float range) const;
+  };
+
+  namespace image {
+
+/*!
+ * Blur with a box of 2 * radius + 1 pixels using running sums, the cost does not depend on the radius.
+ * Source and destination must have the same size and may be the same image.
+ *
+ * @param source - Pixels to blur.
+ * @param destination - Pixels to write.
+ * @param radius - Distance of the farthest pixel averaged.
+ * @param border - Pixels read outside of the source.
+ */
+  void boxBlur(const ImageView<ppgso::Image::Pixel> &source, const ImageSpan<ppgso::Image::Pixel> &destination,
+               int radius, BorderMode border = BorderMode::Clamp);
+
+  void boxBlur(const ImageView<ppgso::ImageRGB32F::Pixel> &source,
+               const ImageSpan<ppgso::ImageRGB32F::Pixel> &destination, int radius,
+               BorderMode border = BorderMode::Clamp);
+
+/*!
+ * Gaussian blur, large sigmas are approximated with three box blurs so the cost does not grow with sigma.
+ * Small sigmas use the exact separable kernel which is faster for them.
+ * Source and destination must have the same size and may be the same image.
+ *
+ * @param source - Pixels to blur.
+ * @param destination - Pixels to write.
+ * @param sigma - Standard deviation in pixels.
+ * @param border - Pixels read outside of the source.
+ */
+  void gaussianBlur(const ImageView<ppgso::Image::Pixel> &source, const ImageSpan<ppgso::Image::Pixel> &destination,
+                    float sigma, BorderMode border = BorderMode::Clamp);
+
+  void gaussianBlur(const ImageView<ppgso::ImageRGB32F::Pixel> &source,
+                    const ImageSpan<ppgso::ImageRGB32F::Pixel> &destination, float sigma,
+                    BorderMode border = BorderMode::Clamp);
+  }
+}
@@ -0,0 +1,351 @@
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+
+#include "image_filter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPGSO_FILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Byte shuffles are compiled for a single function and selected at runtime, this needs GCC or Clang function targets
+#if defined(PPGSO_FILTER_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPGSO_FILTER_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace ppgso {
+
+  // Pixels of a block, the planes of a block are this long
+  const int PLANE_SIZE = PointFilter::BLOCK;
+
+  /*!
+   * Split interleaved pixels into planes or interleave planes into pixels.
+   *
+   * @param pixels - Interleaved pixels.
+   * @param planes - Red, green and blue planes.
+   * @param count - Number of pixels, at most PLANE_SIZE.
+   */
+  using Converter = void (*)(Image::Pixel *pixels, uint8_t (*planes)[PLANE_SIZE], int count);
+
+  static void splitScalar(Image::Pixel *pixels, uint8_t (*planes)[PLANE_SIZE], int count) {
+    for (int i = 0; i < count; i++) {
+      planes[0][i] = pixels[i].r;
+      planes[1][i] = pixels[i].g;
+      planes[2][i] = pixels[i].b;
+    }
+  }
+
+  static void mergeScalar(Image::Pixel *pixels, uint8_t (*planes)[PLANE_SIZE], int count) {
+    for (int i = 0; i < count; i++)
+      pixels[i] = {planes[0][i], planes[1][i], planes[2][i]};
+  }
+
+#ifdef PPGSO_FILTER_SSSE3
+  /*!
+   * Shuffle masks of 16 pixels stored in three registers, bytes with the high bit set are zeroed by the shuffle.
+   */
+  struct ShuffleMasks {
+    // Plane, source register and lane of the split
+    alignas(16) uint8_t split[3][3][16];
+    // Destination register, plane and lane of the merge
+    alignas(16) uint8_t merge[3][3][16];
+
+    ShuffleMasks() {
+      for (int c = 0; c < 3; c++)
+        for (int k = 0; k < 3; k++)
+          for (int i = 0; i < 16; i++) {
+            int source = i * 3 + c;
+            split[c][k][i] = (uint8_t) (source / 16 == k ? source % 16 : 0x80);
+            int destination = k * 16 + i;
+            merge[k][c][i] = (uint8_t) (destination % 3 == c ? destination / 3 : 0x80);
+          }
+    }
+  };
+
+  static const ShuffleMasks &shuffleMasks() {
+    static const ShuffleMasks masks;
+    return masks;
+  }
+
+  __attribute__((target("ssse3")))
+  static void splitSSSE3(Image::Pixel *pixels, uint8_t (*planes)[PLANE_SIZE], int count) {
+    if (count < PLANE_SIZE) return splitScalar(pixels, planes, count);
+    auto &masks = shuffleMasks();
+    for (int i = 0; i < PLANE_SIZE; i += 16) {
+      auto bytes = (const __m128i *) (pixels + i);
+      __m128i chunk[3] = {_mm_loadu_si128(bytes), _mm_loadu_si128(bytes + 1), _mm_loadu_si128(bytes + 2)};
+      for (int c = 0; c < 3; c++) {
+        auto plane = _mm_setzero_si128();
+        for (int k = 0; k < 3; k++)
+          plane = _mm_or_si128(plane, _mm_shuffle_epi8(chunk[k], _mm_load_si128((const __m128i *) masks.split[c][k])));
+        _mm_store_si128((__m128i *) &planes[c][i], plane);
+      }
+    }
+  }
+
+  __attribute__((target("ssse3")))
+  static void mergeSSSE3(Image::Pixel *pixels, uint8_t (*planes)[PLANE_SIZE], int count) {
+    if (count < PLANE_SIZE) return mergeScalar(pixels, planes, count);
+    auto &masks = shuffleMasks();
+    for (int i = 0; i < PLANE_SIZE; i += 16) {
+      __m128i plane[3];
+      for (int c = 0; c < 3; c++)
+        plane[c] = _mm_load_si128((const __m128i *) &planes[c][i]);
+      auto bytes = (__m128i *) (pixels + i);
+      for (int k = 0; k < 3; k++) {
+        auto chunk = _mm_setzero_si128();
+        for (int c = 0; c < 3; c++)
+          chunk = _mm_or_si128(chunk, _mm_shuffle_epi8(plane[c], _mm_load_si128((const __m128i *) masks.merge[k][c])));
+        _mm_storeu_si128(bytes + k, chunk);
+      }
+    }
+  }
+#endif
+
+  /*!
+   * Select split and merge functions supported by the CPU, the choice is made once.
+   */
+  static void selectConverters(Converter &split, Converter &merge) {
+    static const struct Selection {
+      Converter split, merge;
+    } selection = [] {
+#ifdef PPGSO_FILTER_SSSE3
+      if (__builtin_cpu_supports("ssse3"))
+        return Selection{splitSSSE3, mergeSSSE3};
+#endif
+      return Selection{splitScalar, mergeScalar};
+    }();
+    split = selection.split;
+    merge = selection.merge;
+  }
+
+  /*!
+   * Truncate and saturate float channel, written so NaN converts to zero like in the vector code.
+   */
+  static uint8_t saturate(float value) {
+    return !(value > 0.0f) ? 0 : value >= 255.0f ? 255 : (uint8_t) value;
+  }
+
+#ifdef PPGSO_FILTER_SSE2
+  /*!
+   * Convert 16 bytes to four float vectors.
+   */
+  static void loadFloats(const uint8_t *bytes, __m128 *values) {
+    auto zero = _mm_setzero_si128();
+    auto data = _mm_load_si128((const __m128i *) bytes);
+    auto low = _mm_unpacklo_epi8(data, zero), high = _mm_unpackhi_epi8(data, zero);
+    values[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+    values[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+    values[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+    values[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+  }
+
+  /*!
+   * Truncate and saturate four float vectors to 16 bytes.
+   */
+  static __m128i storeFloats(const __m128 *values) {
+    __m128i integers[4];
+    for (int k = 0; k < 4; k++)
+      integers[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(values[k], _mm_setzero_ps()), _mm_set1_ps(255.0f)));
+    return _mm_packus_epi16(_mm_packs_epi32(integers[0], integers[1]), _mm_packs_epi32(integers[2], integers[3]));
+  }
+#endif
+
+  PointFilter &PointFilter::luminance(float red, float green, float blue) {
+    Step step{Operation::Luminance};
+    step.weights[0] = red;
+    step.weights[1] = green;
+    step.weights[2] = blue;
+    steps.push_back(step);
+    return *this;
+  }
+
+  PointFilter &PointFilter::gainBias(float gain, float bias) {
+    Step step{Operation::GainBias};
+    step.weights[0] = gain;
+    step.weights[1] = bias;
+    steps.push_back(step);
+    return *this;
+  }
+
+  PointFilter &PointFilter::gamma(float gamma) {
+    uint8_t curve[256];
+    for (int i = 0; i < 256; i++)
+      curve[i] = saturate(255.0f * std::pow(i / 255.0f, gamma) + 0.5f);
+    return curves(curve, curve, curve);
+  }
+
+  PointFilter &PointFilter::curves(const uint8_t *red, const uint8_t *green, const uint8_t *blue) {
+    Step step{Operation::Curves};
+    step.curves.insert(step.curves.end(), red, red + 256);
+    step.curves.insert(step.curves.end(), green, green + 256);
+    step.curves.insert(step.curves.end(), blue, blue + 256);
+    steps.push_back(std::move(step));
+    return *this;
+  }
+
+  PointFilter &PointFilter::colorLUT(const std::vector<Image::Pixel> &table, int size) {
+    if (size < 2 || table.size() != (size_t) size * size * size) {
+      std::stringstream msg;
+      msg << "Color lookup table of size " << size << " needs " << size << "^3 entries, got " << table.size() << ".";
+      throw std::runtime_error(msg.str());
+    }
+    Step step{Operation::ColorLUT};
+    step.table = table;
+    step.size = size;
+    steps.push_back(std::move(step));
+    return *this;
+  }
+
+  PointFilter &PointFilter::swizzle(int red, int green, int blue) {
+    Step step{Operation::Swizzle};
+    step.channels[0] = red;
+    step.channels[1] = green;
+    step.channels[2] = blue;
+    for (auto channel : step.channels) {
+      if (channel < 0 || channel > 2) {
+        std::stringstream msg;
+        msg << "Channel index " << channel << " is not 0, 1 or 2.";
+        throw std::runtime_error(msg.str());
+      }
+    }
+    steps.push_back(step);
+    return *this;
+  }
+
+  PointFilter &PointFilter::threshold(uint8_t level) {
+    Step step{Operation::Threshold};
+    step.channels[0] = level;
+    steps.push_back(step);
+    return *this;
+  }
+
+  void PointFilter::applyStep(const Step &step, uint8_t (*planes)[BLOCK]) {
+    switch (step.operation) {
+      case Operation::Luminance: {
+        int i = 0;
+#ifdef PPGSO_FILTER_SSE2
+        for (; i < BLOCK; i += 16) {
+          __m128 red[4], green[4], blue[4], result[4];
+          loadFloats(&planes[0][i], red);
+          loadFloats(&planes[1][i], green);
+          loadFloats(&planes[2][i], blue);
+          for (int k = 0; k < 4; k++)
+            result[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(step.weights[0]), red[k]),
+                                              _mm_mul_ps(_mm_set1_ps(step.weights[1]), green[k])),
+                                   _mm_mul_ps(_mm_set1_ps(step.weights[2]), blue[k]));
+          auto gray = storeFloats(result);
+          for (int c = 0; c < 3; c++)
+            _mm_store_si128((__m128i *) &planes[c][i], gray);
+        }
+#endif
+        for (; i < BLOCK; i++) {
+          auto gray = saturate(step.weights[0] * planes[0][i] + step.weights[1] * planes[1][i] +
+                               step.weights[2] * planes[2][i]);
+          planes[0][i] = planes[1][i] = planes[2][i] = gray;
+        }
+        break;
+      }
+      case Operation::GainBias:
+        for (int c = 0; c < 3; c++) {
+          int i = 0;
+#ifdef PPGSO_FILTER_SSE2
+          for (; i < BLOCK; i += 16) {
+            __m128 values[4];
+            loadFloats(&planes[c][i], values);
+            for (auto &value : values)
+              value = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(step.weights[0])), _mm_set1_ps(step.weights[1]));
+            _mm_store_si128((__m128i *) &planes[c][i], storeFloats(values));
+          }
+#endif
+          for (; i < BLOCK; i++)
+            planes[c][i] = saturate(planes[c][i] * step.weights[0] + step.weights[1]);
+        }
+        break;
+      case Operation::Curves:
+        for (int c = 0; c < 3; c++) {
+          auto curve = &step.curves[c * 256];
+          for (int i = 0; i < BLOCK; i++)
+            planes[c][i] = curve[planes[c][i]];
+        }
+        break;
+      case Operation::ColorLUT: {
+        float scale = (step.size - 1) / 255.0f;
+        auto entry = [&step](int r, int g, int b) { return step.table[(b * step.size + g) * step.size + r]; };
+        for (int i = 0; i < BLOCK; i++) {
+          // Lower corner of the cell and position within it
+          float position[3];
+          int corner[3];
+          for (int c = 0; c < 3; c++) {
+            position[c] = planes[c][i] * scale;
+            corner[c] = std::min((int) position[c], step.size - 2);
+            position[c] -= corner[c];
+          }
+          float color[3] = {};
+          for (int k = 0; k < 8; k++) {
+            int r = k & 1, g = (k >> 1) & 1, b = k >> 2;
+            float weight = (r ? position[0] : 1 - position[0]) * (g ? position[1] : 1 - position[1]) *
+                           (b ? position[2] : 1 - position[2]);
+            auto sample = entry(corner[0] + r, corner[1] + g, corner[2] + b);
+            color[0] += weight * sample.r;
+            color[1] += weight * sample.g;
+            color[2] += weight * sample.b;
+          }
+          for (int c = 0; c < 3; c++)
+            planes[c][i] = saturate(color[c] + 0.5f);
+        }
+        break;
+      }
+      case Operation::Swizzle: {
+        uint8_t source[3][BLOCK];
+        std::memcpy(source, planes, sizeof(source));
+        for (int c = 0; c < 3; c++)
+          std::memcpy(planes[c], source[step.channels[c]], BLOCK);
+        break;
+      }
+      case Operation::Threshold: {
+        auto level = (uint8_t) step.channels[0];
+        for (int c = 0; c < 3; c++) {
+          int i = 0;
+#ifdef PPGSO_FILTER_SSE2
+          // Unsigned bytes are at least the level when the maximum of both is the byte itself
+          auto levels = _mm_set1_epi8((char) level);
+          for (; i < BLOCK; i += 16) {
+            auto values = _mm_load_si128((const __m128i *) &planes[c][i]);
+            _mm_store_si128((__m128i *) &planes[c][i], _mm_cmpeq_epi8(_mm_max_epu8(values, levels), values));
+          }
+#endif
+          for (; i < BLOCK; i++)
+            planes[c][i] = planes[c][i] >= level ? 255 : 0;
+        }
+        break;
+      }
+    }
+  }
+
+  void PointFilter::apply(Image::Pixel *pixels, size_t count) const {
+    if (steps.empty()) return;
+    Converter split, merge;
+    selectConverters(split, merge);
+
+    alignas(16) uint8_t planes[3][BLOCK];
+    for (size_t start = 0; start < count; start += BLOCK) {
+      int size = (int) std::min<size_t>((size_t) BLOCK, count - start);
+      // Lanes past the end of a partial block are processed too, keep them defined
+      if (size < BLOCK) std::memset(planes, 0, sizeof(planes));
+      split(pixels + start, planes, size);
+      for (auto &step : steps)
+        applyStep(step, planes);
+      merge(pixels + start, planes, size);
+    }
+  }
+
+  void PointFilter::apply(const ImageSpan<Image::Pixel> &span) const {
+    #pragma omp parallel for
+    for (int y = 0; y < span.height; y++)
+      apply(span.row(y), span.width);
+  }
+}
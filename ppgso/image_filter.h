@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "image.h"
+
+namespace ppgso {
+
+  /*!
+   * Chain of per-pixel operations on RGB8 pixels applied in a single pass.
+   * Pixels are processed in blocks that are split into red, green and blue planes, every operation of the chain is
+   * applied to the planes while they are in cache and the block is interleaved back, so the pixels are read and written
+   * once no matter how long the chain is. Splitting and interleaving uses byte shuffles when the CPU supports them.
+   *
+   * Arithmetic operations work in float, results are truncated and saturated to <0, 255>.
+   */
+  class PointFilter {
+  public:
+    // Number of pixels processed at once
+    static const int BLOCK = 64;
+
+    /*!
+     * Replace all channels with weighted sum of the channels.
+     *
+     * @param red - Weight of the red channel.
+     * @param green - Weight of the green channel.
+     * @param blue - Weight of the blue channel.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &luminance(float red = 0.299f, float green = 0.587f, float blue = 0.114f);
+
+    /*!
+     * Multiply channels by gain and add bias.
+     *
+     * @param gain - Factor to multiply the channels with.
+     * @param bias - Value to add after the multiplication.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &gainBias(float gain, float bias = 0.0f);
+
+    /*!
+     * Apply gamma correction, channels are normalized to <0, 1> and raised to the power.
+     *
+     * @param gamma - Exponent of the correction.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &gamma(float gamma);
+
+    /*!
+     * Map channels through lookup tables, for example tone curves.
+     *
+     * @param red - 256 values for the red channel.
+     * @param green - 256 values for the green channel.
+     * @param blue - 256 values for the blue channel.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &curves(const uint8_t *red, const uint8_t *green, const uint8_t *blue);
+
+    /*!
+     * Map colors through a 3D lookup table with trilinear interpolation.
+     *
+     * @param table - size^3 colors, red changes fastest and blue slowest.
+     * @param size - Number of entries along each axis, at least 2.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &colorLUT(const std::vector<Image::Pixel> &table, int size);
+
+    /*!
+     * Reorder channels.
+     *
+     * @param red - Index of the source channel of red, 0 is red, 1 green and 2 blue.
+     * @param green - Index of the source channel of green.
+     * @param blue - Index of the source channel of blue.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &swizzle(int red, int green, int blue);
+
+    /*!
+     * Set channels to 255 when they are at least the level and to 0 otherwise.
+     *
+     * @param level - Threshold level.
+     * @return - The filter to chain more operations.
+     */
+    PointFilter &threshold(uint8_t level);
+
+    /*!
+     * Apply the chain to a run of pixels.
+     *
+     * @param pixels - First pixel.
+     * @param count - Number of pixels.
+     */
+    void apply(Image::Pixel *pixels, size_t count) const;
+
+    /*!
+     * Apply the chain to all pixels of a span, rows are processed in parallel.
+     *
+     * @param span - Pixels to filter, may be a crop or tile of a larger image.
+     */
+    void apply(const ImageSpan<Image::Pixel> &span) const;
+
+    /*!
+     * Check if the filter contains any operation.
+     *
+     * @return - True when the chain is empty.
+     */
+    bool empty() const {
+      return steps.empty();
+    }
+
+  private:
+    enum class Operation {
+      Luminance, GainBias, Curves, ColorLUT, Swizzle, Threshold
+    };
+
+    struct Step {
+      explicit Step(Operation operation) : operation{operation} {}
+
+      Operation operation;
+      float weights[3] = {0, 0, 0};
+      int channels[3] = {0, 1, 2};
+      std::vector<uint8_t> curves;
+      std::vector<Image::Pixel> table;
+      int size = 0;
+    };
+
+    std::vector<Step> steps;
+
+    /*!
+     * Apply single operation to a block of pixels split into planes.
+     *
+     * @param step - Operation to apply.
+     * @param planes - Red, green and blue planes of BLOCK pixels.
+     */
+    static void applyStep(const Step &step, uint8_t (*planes)[BLOCK]);
+  };
+}
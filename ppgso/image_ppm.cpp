@@ -0,0 +1,211 @@
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "image_ppm.h"
+
+namespace ppgso {
+  namespace image {
+
+    /*!
+     * Read next whitespace separated token of a PPM or PFM header, comments are skipped.
+     *
+     * @param input - Stream positioned in the header.
+     * @return - Token, empty at the end of the stream.
+     */
+    static std::string readToken(std::istream &input) {
+      std::string token;
+      int c;
+      while ((c = input.get()) != EOF) {
+        if (c == '#') {
+          while ((c = input.get()) != EOF && c != '\n');
+        } else if (!std::isspace(c)) {
+          token.push_back((char) c);
+          break;
+        }
+      }
+      while ((c = input.peek()) != EOF && !std::isspace(c)) {
+        token.push_back((char) c);
+        input.get();
+      }
+      // A single whitespace separates the header from the pixel data
+      input.get();
+      return token;
+    }
+
+    /*!
+     * Read the size tokens of a header.
+     *
+     * @param input - Stream positioned after the magic number.
+     * @param file - File name used in error messages.
+     * @param width - Width of the image.
+     * @param height - Height of the image.
+     */
+    static void readSize(std::istream &input, const std::string &file, int &width, int &height) {
+      width = std::atoi(readToken(input).c_str());
+      height = std::atoi(readToken(input).c_str());
+      if (width <= 0 || height <= 0) {
+        std::stringstream msg;
+        msg << "Image file does not contain any data. " << file;
+        throw std::runtime_error(msg.str());
+      }
+    }
+
+    static std::ifstream openInput(const std::string &file) {
+      std::ifstream input_file(file, std::ios::binary);
+      if (!input_file.is_open()) {
+        std::stringstream msg;
+        msg << "Could not open image " << file;
+        throw std::runtime_error(msg.str());
+      }
+      return input_file;
+    }
+
+    static std::ofstream openOutput(const std::string &file) {
+      std::ofstream output_file(file, std::ios::binary);
+      if (!output_file.is_open()) {
+        std::stringstream msg;
+        msg << "Could not open image for writing " << file;
+        throw std::runtime_error(msg.str());
+      }
+      return output_file;
+    }
+
+    static void checkRead(std::istream &input, const std::string &file) {
+      if (!input) {
+        std::stringstream msg;
+        msg << "Image file is truncated. " << file;
+        throw std::runtime_error(msg.str());
+      }
+    }
+
+    Image loadPPM(const std::string &ppm) {
+      auto input_file = openInput(ppm);
+
+      if (readToken(input_file) != "P6") {
+        std::stringstream msg;
+        msg << "PPM file does not contain supported binary PPM format. " << ppm;
+        throw std::runtime_error(msg.str());
+      }
+
+      int width, height;
+      readSize(input_file, ppm, width, height);
+      int maximum = std::atoi(readToken(input_file).c_str());
+      if (maximum <= 0 || maximum > 65535) {
+        std::stringstream msg;
+        msg << "PPM file does not contain supported maximum value. " << ppm;
+        throw std::runtime_error(msg.str());
+      }
+
+      Image image{width, height};
+      auto &framebuffer = image.getFramebuffer();
+
+      if (maximum == 255) {
+        input_file.read((char *) framebuffer.data(), framebuffer.size() * sizeof(Image::Pixel));
+        checkRead(input_file, ppm);
+        return image;
+      }
+
+      // Other precisions are scaled row by row, 16 bit values are big endian
+      int bytes = maximum > 255 ? 2 : 1;
+      std::vector<uint8_t> row((size_t) width * 3 * bytes);
+      for (int y = 0; y < height; y++) {
+        input_file.read((char *) row.data(), row.size());
+        checkRead(input_file, ppm);
+        auto pixels = (uint8_t *) &framebuffer[(size_t) y * width];
+        for (int i = 0; i < width * 3; i++) {
+          int value = bytes == 2 ? row[i * 2] << 8 | row[i * 2 + 1] : row[i];
+          pixels[i] = (uint8_t) ((std::min(value, maximum) * 255 + maximum / 2) / maximum);
+        }
+      }
+      return image;
+    }
+
+    void savePPM(Image &image, const std::string &ppm) {
+      savePPM(image.view(), ppm);
+    }
+
+    void savePPM(const ImageView<Image::Pixel> &view, const std::string &ppm) {
+      auto output_file = openOutput(ppm);
+      output_file << "P6\n" << view.width << " " << view.height << "\n255\n";
+
+      // Rows are stored as they are in memory
+      if (view.isContiguous()) {
+        output_file.write((const char *) view.data, view.stride * view.height);
+      } else {
+        for (auto row : view.rows())
+          output_file.write((const char *) row.begin(), row.width * sizeof(Image::Pixel));
+      }
+    }
+
+    static bool isLittleEndian() {
+      uint16_t value = 1;
+      uint8_t first;
+      std::memcpy(&first, &value, 1);
+      return first == 1;
+    }
+
+    ImageRGB32F loadPFM(const std::string &pfm) {
+      auto input_file = openInput(pfm);
+
+      auto format = readToken(input_file);
+      if (format != "PF" && format != "Pf") {
+        std::stringstream msg;
+        msg << "PFM file does not contain supported PFM format. " << pfm;
+        throw std::runtime_error(msg.str());
+      }
+
+      int width, height;
+      readSize(input_file, pfm, width, height);
+      // Sign of the scale is the byte order, negative for little endian
+      bool swap = (std::atof(readToken(input_file).c_str()) < 0) != isLittleEndian();
+      int channels = format == "PF" ? 3 : 1;
+
+      // Rows are stored from bottom to top
+      ImageRGB32F image{width, height};
+      std::vector<float> row((size_t) width * channels);
+      for (int y = height - 1; y >= 0; y--) {
+        input_file.read((char *) row.data(), row.size() * sizeof(float));
+        checkRead(input_file, pfm);
+        if (swap) {
+          for (auto &value : row) {
+            auto bytes = (uint8_t *) &value;
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+          }
+        }
+        auto pixels = image.row(y);
+        for (int x = 0; x < width; x++)
+          for (int c = 0; c < 3; c++)
+            pixels[x][c] = row[x * channels + c % channels];
+      }
+      return image;
+    }
+
+    /*!
+     * Save floating point pixels as PFM in the native byte order.
+     *
+     * @param view - Pixels to save.
+     * @param channels - Number of channels of the pixels, 1 or 3.
+     * @param pfm - Name of the PFM file to save image to.
+     */
+    template<typename P>
+    static void writePFM(const ImageView<P> &view, int channels, const std::string &pfm) {
+      auto output_file = openOutput(pfm);
+      output_file << (channels == 3 ? "PF" : "Pf") << "\n" << view.width << " " << view.height << "\n"
+                  << (isLittleEndian() ? "-1.0" : "1.0") << "\n";
+      for (int y = view.height - 1; y >= 0; y--)
+        output_file.write((const char *) view.row(y), view.width * sizeof(P));
+    }
+
+    void savePFM(const ImageView<ImageRGB32F::Pixel> &view, const std::string &pfm) {
+      writePFM(view, 3, pfm);
+    }
+
+    void savePFM(const ImageView<ImageR32F::Pixel> &view, const std::string &pfm) {
+      writePFM(view, 1, pfm);
+    }
+
+  }
+}
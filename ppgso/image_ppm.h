@@ -0,0 +1,49 @@
+#pragma once
+#include "image.h"
+#include "image_buffer.h"
+
+namespace ppgso {
+  namespace image {
+/*!
+ * Load binary PPM image (P6) from file, 16 bit and low precision images are scaled to 8 bits.
+ *
+ * @param ppm - File path to a PPM image.
+ */
+  ppgso::Image loadPPM(const std::string &ppm);
+
+/*!
+ * Save as binary PPM image.
+ * @param image - Image to save.
+ * @param ppm - Name of the PPM file to save image to.
+ */
+  void savePPM(ppgso::Image &image, const std::string &ppm);
+
+/*!
+ * Save part of an image as binary PPM image.
+ * @param view - Pixels to save, may be a crop or tile of a larger image.
+ * @param ppm - Name of the PPM file to save image to.
+ */
+  void savePPM(const ImageView<ppgso::Image::Pixel> &view, const std::string &ppm);
+
+/*!
+ * Load PFM image with floating point pixels from file, grayscale images are loaded into all three channels.
+ *
+ * @param pfm - File path to a PFM image.
+ */
+  ppgso::ImageRGB32F loadPFM(const std::string &pfm);
+
+/*!
+ * Save floating point image as color PFM image.
+ * @param view - Pixels to save.
+ * @param pfm - Name of the PFM file to save image to.
+ */
+  void savePFM(const ImageView<ppgso::ImageRGB32F::Pixel> &view, const std::string &pfm);
+
+/*!
+ * Save single channel floating point image as grayscale PFM image.
+ * @param view - Pixels to save.
+ * @param pfm - Name of the PFM file to save image to.
+ */
+  void savePFM(const ImageView<ppgso::ImageR32F::Pixel> &view, const std::string &pfm);
+  }
+}
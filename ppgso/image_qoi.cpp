@@ -0,0 +1,203 @@
+#include <fstream>
+#include <sstream>
+
+#include "image_qoi.h"
+
+namespace ppgso {
+  namespace image {
+
+    // Operations of the QOI format
+    const uint8_t QOI_OP_INDEX = 0x00;
+    const uint8_t QOI_OP_DIFF = 0x40;
+    const uint8_t QOI_OP_LUMA = 0x80;
+    const uint8_t QOI_OP_RUN = 0xc0;
+    const uint8_t QOI_OP_RGB = 0xfe;
+    const uint8_t QOI_OP_RGBA = 0xff;
+    const uint8_t QOI_MASK = 0xc0;
+
+    // Header and end marker sizes in bytes
+    const size_t QOI_HEADER_SIZE = 14;
+    const uint8_t QOI_END[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+    static int hash(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+      return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+    }
+
+    static void writeBigEndian(std::vector<uint8_t> &buffer, uint32_t value) {
+      for (int shift = 24; shift >= 0; shift -= 8)
+        buffer.push_back((uint8_t) (value >> shift));
+    }
+
+    QOIEncoder::QOIEncoder(std::ostream &output, int width, int height) : output{output}, width{width} {
+      buffer = {'q', 'o', 'i', 'f'};
+      writeBigEndian(buffer, (uint32_t) width);
+      writeBigEndian(buffer, (uint32_t) height);
+      buffer.push_back(3); // RGB channels
+      buffer.push_back(0); // sRGB with linear alpha
+      output.write((const char *) buffer.data(), buffer.size());
+    }
+
+    void QOIEncoder::write(const Image::Pixel *row) {
+      // A pixel encodes to at most 4 bytes, plus one for a run carried over from the previous row
+      buffer.resize((size_t) width * 4 + 1);
+      auto out = buffer.data();
+      for (int x = 0; x < width; x++) {
+        Color pixel = {row[x].r, row[x].g, row[x].b, 255};
+        if (pixel.r == previous.r && pixel.g == previous.g && pixel.b == previous.b) {
+          if (++run == 62) {
+            *out++ = (uint8_t) (QOI_OP_RUN | (run - 1));
+            run = 0;
+          }
+          continue;
+        }
+        if (run > 0) {
+          *out++ = (uint8_t) (QOI_OP_RUN | (run - 1));
+          run = 0;
+        }
+
+        int position = hash(pixel.r, pixel.g, pixel.b, pixel.a);
+        auto &cached = index[position];
+        if (cached.r == pixel.r && cached.g == pixel.g && cached.b == pixel.b && cached.a == pixel.a) {
+          *out++ = (uint8_t) (QOI_OP_INDEX | position);
+        } else {
+          cached = pixel;
+          // Differences wrap around like the channels do
+          auto dr = (int8_t) (pixel.r - previous.r);
+          auto dg = (int8_t) (pixel.g - previous.g);
+          auto db = (int8_t) (pixel.b - previous.b);
+          int drg = dr - dg, dbg = db - dg;
+          if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+            *out++ = (uint8_t) (QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+          } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+            *out++ = (uint8_t) (QOI_OP_LUMA | (dg + 32));
+            *out++ = (uint8_t) ((drg + 8) << 4 | (dbg + 8));
+          } else {
+            *out++ = QOI_OP_RGB;
+            *out++ = pixel.r;
+            *out++ = pixel.g;
+            *out++ = pixel.b;
+          }
+        }
+        previous = pixel;
+      }
+      output.write((const char *) buffer.data(), out - buffer.data());
+    }
+
+    void QOIEncoder::finish() {
+      if (run > 0) {
+        auto op = (char) (QOI_OP_RUN | (run - 1));
+        output.write(&op, 1);
+        run = 0;
+      }
+      output.write((const char *) QOI_END, sizeof(QOI_END));
+    }
+
+    Image loadQOI(const std::string &qoi) {
+      std::ifstream input_file(qoi, std::ios::binary);
+
+      if (!input_file.is_open()) {
+        std::stringstream msg;
+        msg << "Could not open QOI file. " << qoi;
+        throw std::runtime_error(msg.str());
+      }
+
+      // The whole file is read at once
+      input_file.seekg(0, input_file.end);
+      std::vector<uint8_t> data((size_t) input_file.tellg());
+      input_file.seekg(0, input_file.beg);
+      input_file.read((char *) data.data(), data.size());
+      auto readBigEndian = [&data](size_t offset) {
+        return (uint32_t) data[offset] << 24 | (uint32_t) data[offset + 1] << 16 |
+               (uint32_t) data[offset + 2] << 8 | (uint32_t) data[offset + 3];
+      };
+
+      if (data.size() < QOI_HEADER_SIZE + sizeof(QOI_END) || data[0] != 'q' || data[1] != 'o' || data[2] != 'i' ||
+          data[3] != 'f') {
+        std::stringstream msg;
+        msg << "QOI file does not contain supported QOI format. " << qoi;
+        throw std::runtime_error(msg.str());
+      }
+
+      auto width = readBigEndian(4), height = readBigEndian(8);
+      if (width == 0 || height == 0 || width > 32768 || height > 32768) {
+        std::stringstream msg;
+        msg << "QOI file does not contain supported image size. " << qoi;
+        throw std::runtime_error(msg.str());
+      }
+
+      Image image{(int) width, (int) height};
+      auto &framebuffer = image.getFramebuffer();
+      QOIEncoder::Color index[64] = {};
+      QOIEncoder::Color pixel = {0, 0, 0, 255};
+      size_t position = QOI_HEADER_SIZE, end = data.size() - sizeof(QOI_END);
+      int run = 0;
+
+      for (auto &output : framebuffer) {
+        if (run > 0) {
+          run--;
+        } else {
+          // Every operation reads at most 5 bytes
+          if (position + 5 > data.size()) {
+            std::stringstream msg;
+            msg << "QOI file is truncated. " << qoi;
+            throw std::runtime_error(msg.str());
+          }
+          uint8_t op = data[position++];
+          if (op == QOI_OP_RGB) {
+            pixel.r = data[position];
+            pixel.g = data[position + 1];
+            pixel.b = data[position + 2];
+            position += 3;
+          } else if (op == QOI_OP_RGBA) {
+            pixel = {data[position], data[position + 1], data[position + 2], data[position + 3]};
+            position += 4;
+          } else if ((op & QOI_MASK) == QOI_OP_INDEX) {
+            pixel = index[op];
+          } else if ((op & QOI_MASK) == QOI_OP_DIFF) {
+            pixel.r += ((op >> 4) & 3) - 2;
+            pixel.g += ((op >> 2) & 3) - 2;
+            pixel.b += (op & 3) - 2;
+          } else if ((op & QOI_MASK) == QOI_OP_LUMA) {
+            uint8_t next = data[position++];
+            int dg = (op & 0x3f) - 32;
+            pixel.r += dg - 8 + ((next >> 4) & 0x0f);
+            pixel.g += dg;
+            pixel.b += dg - 8 + (next & 0x0f);
+          } else {
+            run = op & 0x3f;
+          }
+          index[hash(pixel.r, pixel.g, pixel.b, pixel.a)] = pixel;
+        }
+        output = {pixel.r, pixel.g, pixel.b};
+      }
+
+      if (position > end) {
+        std::stringstream msg;
+        msg << "QOI file is truncated. " << qoi;
+        throw std::runtime_error(msg.str());
+      }
+
+      return image;
+    }
+
+    void saveQOI(Image &image, const std::string &qoi) {
+      saveQOI(image.view(), qoi);
+    }
+
+    void saveQOI(const ImageView<Image::Pixel> &view, const std::string &qoi) {
+      std::ofstream output_file(qoi, std::ios::binary);
+
+      if (!output_file.is_open()) {
+        std::stringstream msg;
+        msg << "Could not open QOI file for writing. " << qoi;
+        throw std::runtime_error(msg.str());
+      }
+
+      QOIEncoder encoder{output_file, view.width, view.height};
+      for (auto row : view.rows())
+        encoder.write(row.begin());
+      encoder.finish();
+    }
+
+  }
+}
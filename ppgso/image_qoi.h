@@ -0,0 +1,75 @@
+#pragma once
+#include <ostream>
+#include <vector>
+
+#include "image.h"
+
+namespace ppgso {
+  namespace image {
+
+/*!
+ * Streaming encoder of the lossless QOI image format.
+ * Rows are encoded one at a time as they are written, the encoder keeps only the state of the format and the bytes of
+ * a single row so frames can be written row by row while they are produced or on a background thread.
+ */
+  class QOIEncoder {
+  public:
+    /*!
+     * Start encoding an image, writes the header.
+     *
+     * @param output - Binary stream to write the image to.
+     * @param width - Width of the image in pixels.
+     * @param height - Height of the image in pixels.
+     */
+    QOIEncoder(std::ostream &output, int width, int height);
+
+    /*!
+     * Encode next row of the image.
+     *
+     * @param row - Pointer to width pixels of the row, rows are written from top to bottom.
+     */
+    void write(const ppgso::Image::Pixel *row);
+
+    /*!
+     * Finish the image after all rows were written, writes the end marker.
+     */
+    void finish();
+
+    /*!
+     * RGBA color tracked by the format, images are always opaque.
+     */
+    struct Color {
+      uint8_t r, g, b, a;
+    };
+
+  private:
+    std::ostream &output;
+    int width;
+    std::vector<uint8_t> buffer;
+    Color index[64] = {};
+    Color previous = {0, 0, 0, 255};
+    int run = 0;
+  };
+
+/*!
+ * Load QOI image from file, alpha of RGBA images is dropped.
+ *
+ * @param qoi - File path to a QOI image.
+ */
+  ppgso::Image loadQOI(const std::string &qoi);
+
+/*!
+ * Save as QOI image.
+ * @param image - Image to save.
+ * @param qoi - Name of the QOI file to save image to.
+ */
+  void saveQOI(ppgso::Image &image, const std::string &qoi);
+
+/*!
+ * Save part of an image as QOI image.
+ * @param view - Pixels to save, may be a crop or tile of a larger image.
+ * @param qoi - Name of the QOI file to save image to.
+ */
+  void saveQOI(const ImageView<ppgso::Image::Pixel> &view, const std::string &qoi);
+  }
+}
@@ -1,7 +1,7 @@
 #include <fstream>
 #include <sstream>
 
-#include "image.h"
+#include "image_raw.h"
 
 namespace ppgso {
   namespace image {
@@ -26,6 +26,10 @@ namespace ppgso {
     }
 
     void saveRAW(Image &image, const std::string &raw) {
+      saveRAW(image.view(), raw);
+    }
+
+    void saveRAW(const ImageView<Image::Pixel> &view, const std::string &raw) {
       std::ofstream image_stream(raw, std::ios::binary);
 
       if (!image_stream.is_open()) {
@@ -34,10 +38,13 @@ namespace ppgso {
         throw std::runtime_error(msg.str());
       }
 
-      auto &framebuffer = image.getFramebuffer();
-
-      // Save the data
-      image_stream.write((char *) framebuffer.data(), framebuffer.size() * sizeof(Image::Pixel));
+      // Save the data, rows of a crop are not contiguous
+      if (view.isContiguous()) {
+        image_stream.write((const char *) view.data, view.stride * view.height);
+      } else {
+        for (auto row : view.rows())
+          image_stream.write((const char *) row.begin(), row.width * sizeof(Image::Pixel));
+      }
       image_stream.close();
     }
 
@@ -16,5 +16,12 @@ namespace ppgso {
  * @param raw - Name of the RAW file to save image to.
  */
   void saveRAW(ppgso::Image &image, const std::string &raw);
+
+/*!
+ * Save part of an image as RAW image.
+ * @param view - Pixels to save, may be a crop or tile of a larger image.
+ * @param raw - Name of the RAW file to save image to.
+ */
+  void saveRAW(const ImageView<ppgso::Image::Pixel> &view, const std::string &raw);
  }
 }
@@ -0,0 +1,457 @@
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "image_resample.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPGSO_RESAMPLE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Byte shuffles are compiled for a single function and selected at runtime, this needs GCC or Clang function targets
+#if defined(PPGSO_RESAMPLE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPGSO_RESAMPLE_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace ppgso {
+
+  // Number of destination rows resampled together from the source rows they need
+  const int BAND_HEIGHT = 64;
+
+  /*!
+   * Average 2x2 pixels of two source rows into one destination row.
+   *
+   * @param top - First source row.
+   * @param bottom - Second source row, the same as the first for images one pixel high.
+   * @param destination - Destination row.
+   * @param width - Width of the source in pixels.
+   * @param count - Width of the destination in pixels.
+   * @return - Number of destination pixels written, the rest is left to the scalar code.
+   */
+  using DownsampleKernel = int (*)(const uint8_t *top, const uint8_t *bottom, uint8_t *destination, int width, int count);
+
+  static int downsampleScalar(const uint8_t *top, const uint8_t *bottom, uint8_t *destination, int width, int count) {
+    for (int x = 0; x < count; x++) {
+      int left = 2 * x * 3, right = std::min(2 * x + 1, width - 1) * 3;
+      for (int c = 0; c < 3; c++)
+        destination[x * 3 + c] = (uint8_t) ((top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c] + 2) >> 2);
+    }
+    return count;
+  }
+
+#ifdef PPGSO_RESAMPLE_SSE2
+  /*!
+   * Average 2x2 pixels for two destination pixels from 16 bytes of both source rows, the 6 result bytes are the lowest.
+   */
+  static __m128i averagePairs(const uint8_t *top, const uint8_t *bottom) {
+    auto zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    auto upper = _mm_loadu_si128((const __m128i *) top), lower = _mm_loadu_si128((const __m128i *) bottom);
+    // Byte i of the rows shifted by a pixel is the same channel of the right neighbour
+    auto upperRight = _mm_srli_si128(upper, 3), lowerRight = _mm_srli_si128(lower, 3);
+    auto low = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(upperRight, zero)),
+                             _mm_add_epi16(_mm_unpacklo_epi8(lower, zero), _mm_unpacklo_epi8(lowerRight, zero)));
+    auto high = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(upperRight, zero)),
+                              _mm_add_epi16(_mm_unpackhi_epi8(lower, zero), _mm_unpackhi_epi8(lowerRight, zero)));
+    auto averages = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(low, two), 2),
+                                     _mm_srli_epi16(_mm_add_epi16(high, two), 2));
+
+    // Averages of the two destination pixels are at bytes 0 to 2 and 6 to 8
+    auto first = _mm_setr_epi8(-1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    auto second = _mm_setr_epi8(0, 0, 0, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    return _mm_or_si128(_mm_and_si128(averages, first), _mm_and_si128(_mm_srli_si128(averages, 3), second));
+  }
+
+  static int downsampleSSE2(const uint8_t *top, const uint8_t *bottom, uint8_t *destination, int width, int count) {
+    // Blocks of 4 destination pixels read 16 bytes at 12 bytes past the start of their 8 source pixels
+    int x = 0;
+    for (; x + 4 <= count && 2 * x + 10 <= width; x += 4) {
+      auto result = _mm_or_si128(averagePairs(top + x * 6, bottom + x * 6),
+                                 _mm_slli_si128(averagePairs(top + x * 6 + 12, bottom + x * 6 + 12), 6));
+      _mm_storel_epi64((__m128i *) (destination + x * 3), result);
+      auto last = _mm_cvtsi128_si32(_mm_srli_si128(result, 8));
+      std::memcpy(destination + x * 3 + 8, &last, 4);
+    }
+    return x;
+  }
+#endif
+
+#ifdef PPGSO_RESAMPLE_SSSE3
+  /*!
+   * Shuffle masks of 16 source pixels in three registers and of 8 destination pixels.
+   */
+  struct DownsampleMasks {
+    // Plane, source register and lane of the split
+    alignas(16) uint8_t split[3][3][16];
+    // Destination register, register of the red and green or the blue sums, and lane of the merge
+    alignas(16) uint8_t merge[2][2][16];
+
+    DownsampleMasks() {
+      for (int c = 0; c < 3; c++)
+        for (int k = 0; k < 3; k++)
+          for (int i = 0; i < 16; i++) {
+            int source = i * 3 + c;
+            split[c][k][i] = (uint8_t) (source / 16 == k ? source % 16 : 0x80);
+          }
+      for (int k = 0; k < 2; k++)
+        for (int i = 0; i < 16; i++) {
+          int destination = k * 16 + i, pixel = destination / 3, c = destination % 3;
+          bool valid = destination < 24;
+          merge[k][0][i] = (uint8_t) (valid && c < 2 ? c * 8 + pixel : 0x80);
+          merge[k][1][i] = (uint8_t) (valid && c == 2 ? pixel : 0x80);
+        }
+    }
+  };
+
+  static const DownsampleMasks &downsampleMasks() {
+    static const DownsampleMasks masks;
+    return masks;
+  }
+
+  /*!
+   * Split 16 pixels into planes and sum neighbouring pixels of each plane.
+   */
+  __attribute__((target("ssse3")))
+  static void pairSums(const uint8_t *pixels, const DownsampleMasks &masks, __m128i *sums) {
+    auto bytes = (const __m128i *) pixels;
+    __m128i chunk[3] = {_mm_loadu_si128(bytes), _mm_loadu_si128(bytes + 1), _mm_loadu_si128(bytes + 2)};
+    auto ones = _mm_set1_epi8(1);
+    for (int c = 0; c < 3; c++) {
+      auto plane = _mm_setzero_si128();
+      for (int k = 0; k < 3; k++)
+        plane = _mm_or_si128(plane, _mm_shuffle_epi8(chunk[k], _mm_load_si128((const __m128i *) masks.split[c][k])));
+      sums[c] = _mm_maddubs_epi16(plane, ones);
+    }
+  }
+
+  __attribute__((target("ssse3")))
+  static int downsampleSSSE3(const uint8_t *top, const uint8_t *bottom, uint8_t *destination, int width, int count) {
+    auto &masks = downsampleMasks();
+    auto two = _mm_set1_epi16(2);
+    // Blocks of 8 destination pixels need 16 source pixels of both rows
+    int x = 0;
+    for (; x + 8 <= count && 2 * x + 16 <= width; x += 8) {
+      __m128i upper[3], lower[3], averages[3];
+      pairSums(top + x * 6, masks, upper);
+      pairSums(bottom + x * 6, masks, lower);
+      for (int c = 0; c < 3; c++)
+        averages[c] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(upper[c], lower[c]), two), 2);
+      auto redGreen = _mm_packus_epi16(averages[0], averages[1]), blue = _mm_packus_epi16(averages[2], averages[2]);
+      __m128i result[2];
+      for (int k = 0; k < 2; k++)
+        result[k] = _mm_or_si128(_mm_shuffle_epi8(redGreen, _mm_load_si128((const __m128i *) masks.merge[k][0])),
+                                 _mm_shuffle_epi8(blue, _mm_load_si128((const __m128i *) masks.merge[k][1])));
+      _mm_storeu_si128((__m128i *) (destination + x * 3), result[0]);
+      _mm_storel_epi64((__m128i *) (destination + x * 3 + 16), result[1]);
+    }
+    return x;
+  }
+#endif
+
+  /*!
+   * Select the downsample kernel supported by the CPU, the choice is made once.
+   */
+  static DownsampleKernel downsampleKernel() {
+    static const DownsampleKernel kernel = [] {
+#ifdef PPGSO_RESAMPLE_SSSE3
+      if (__builtin_cpu_supports("ssse3"))
+        return downsampleSSSE3;
+#endif
+#ifdef PPGSO_RESAMPLE_SSE2
+      return downsampleSSE2;
+#else
+      return downsampleScalar;
+#endif
+    }();
+    return kernel;
+  }
+
+  /*!
+   * Weights of a resampling along one axis, destination pixel i is the weighted sum of count[i] source pixels starting
+   * with first[i], its weights start at weights[i * taps].
+   */
+  struct WeightTable {
+    int taps = 0;
+    std::vector<int> first, count;
+    std::vector<float> weights;
+
+    WeightTable(int size, int taps) : taps{taps}, first((size_t) size), count((size_t) size),
+                                      weights((size_t) size * taps) {}
+  };
+
+  static double sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= 3.14159265358979323846;
+    return std::sin(x) / x;
+  }
+
+  static double bilinear(double x) {
+    x = std::fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+  }
+
+  static double bicubic(double x) {
+    // Keys cubic with a = -0.5, it interpolates and is the Catmull-Rom spline
+    const double a = -0.5;
+    x = std::fabs(x);
+    if (x < 1.0) return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    if (x < 2.0) return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+    return 0.0;
+  }
+
+  static double lanczos(double x) {
+    return std::fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+  }
+
+  /*!
+   * Compute weights of a filter along one axis, weights that would read outside of the source are left out and the rest
+   * is normalized.
+   *
+   * @param sourceSize - Number of source pixels.
+   * @param destinationSize - Number of destination pixels.
+   * @param filter - Resampling filter.
+   * @return - Weight table.
+   */
+  static WeightTable filterWeights(int sourceSize, int destinationSize, image::ResampleFilter filter) {
+    double (*function)(double) = lanczos;
+    double support = 3.0;
+    if (filter == image::ResampleFilter::Bilinear) {
+      function = bilinear;
+      support = 1.0;
+    } else if (filter == image::ResampleFilter::Bicubic) {
+      function = bicubic;
+      support = 2.0;
+    }
+
+    double scale = (double) sourceSize / destinationSize;
+    double stretch = std::max(scale, 1.0), reach = support * stretch;
+    WeightTable table{destinationSize, (int) std::ceil(2.0 * reach) + 1};
+    std::vector<double> weights((size_t) table.taps);
+    for (int i = 0; i < destinationSize; i++) {
+      double center = (i + 0.5) * scale;
+      int first = std::max((int) std::floor(center - reach + 0.5), 0);
+      int last = std::min((int) std::floor(center + reach + 0.5), sourceSize);
+      last = std::min(last, first + table.taps);
+      double total = 0.0;
+      for (int k = 0; k < last - first; k++) {
+        weights[k] = function((first + k + 0.5 - center) / stretch);
+        total += weights[k];
+      }
+      table.first[i] = first;
+      table.count[i] = last - first;
+      for (int k = 0; k < last - first; k++)
+        table.weights[(size_t) i * table.taps + k] = (float) (total != 0.0 ? weights[k] / total : 0.0);
+    }
+    return table;
+  }
+
+  /*!
+   * Compute weights of the binomial 1 4 6 4 1 filter centered on every other source pixel, edges are clamped so the
+   * weights outside of the source are added to the edge pixel.
+   *
+   * @param sourceSize - Number of source pixels.
+   * @param destinationSize - Number of destination pixels.
+   * @return - Weight table.
+   */
+  static WeightTable reduceWeights(int sourceSize, int destinationSize) {
+    const float binomial[5] = {1 / 16.0f, 4 / 16.0f, 6 / 16.0f, 4 / 16.0f, 1 / 16.0f};
+    WeightTable table{destinationSize, 5};
+    for (int i = 0; i < destinationSize; i++) {
+      int first = std::min(std::max(2 * i - 2, 0), sourceSize - 1);
+      int last = std::min(std::max(2 * i + 2, 0), sourceSize - 1);
+      table.first[i] = first;
+      table.count[i] = last - first + 1;
+      for (int k = 0; k < 5; k++) {
+        int source = std::min(std::max(2 * i - 2 + k, 0), sourceSize - 1);
+        table.weights[(size_t) i * 5 + source - first] += binomial[k];
+      }
+    }
+    return table;
+  }
+
+  /*!
+   * Resample rows of RGBX float pixels along the row.
+   *
+   * @param source - Source row, 4 floats per pixel.
+   * @param columns - Weights of the destination pixels.
+   * @param destination - Destination row, 4 floats per pixel.
+   */
+  static void resampleRow(const float *source, const WeightTable &columns, float *destination) {
+    int width = (int) columns.first.size();
+    for (int x = 0; x < width; x++) {
+      auto pixels = source + columns.first[x] * 4;
+      auto weights = &columns.weights[(size_t) x * columns.taps];
+      int count = columns.count[x];
+#ifdef PPGSO_RESAMPLE_SSE2
+      auto sum = _mm_setzero_ps();
+      for (int k = 0; k < count; k++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pixels + k * 4), _mm_load1_ps(weights + k)));
+      _mm_storeu_ps(destination + x * 4, sum);
+#else
+      float sum[4] = {};
+      for (int k = 0; k < count; k++)
+        for (int c = 0; c < 4; c++)
+          sum[c] += pixels[k * 4 + c] * weights[k];
+      std::memcpy(destination + x * 4, sum, sizeof(sum));
+#endif
+    }
+  }
+
+  /*!
+   * Weighted sum of rows, value i of the result is the sum of the weights times value i of the rows.
+   *
+   * @param rows - Rows to sum.
+   * @param weights - Weight of each row.
+   * @param count - Number of rows.
+   * @param size - Number of values in a row.
+   * @param result - Row of the sums.
+   */
+  static void sumRows(const float *const *rows, const float *weights, int count, int size, float *result) {
+    int i = 0;
+#ifdef PPGSO_RESAMPLE_SSE2
+    for (; i + 8 <= size; i += 8) {
+      auto low = _mm_setzero_ps(), high = _mm_setzero_ps();
+      for (int k = 0; k < count; k++) {
+        auto weight = _mm_load1_ps(weights + k);
+        low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), weight));
+        high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(rows[k] + i + 4), weight));
+      }
+      _mm_storeu_ps(result + i, low);
+      _mm_storeu_ps(result + i + 4, high);
+    }
+#endif
+    for (; i < size; i++) {
+      float sum = 0.0f;
+      for (int k = 0; k < count; k++)
+        sum += rows[k][i] * weights[k];
+      result[i] = sum;
+    }
+  }
+
+  /*!
+   * Resample with separable weights, destination rows are computed in bands from the source rows resampled along the
+   * row once per band.
+   *
+   * @param source - Pixels to resample.
+   * @param destination - Pixels to write.
+   * @param columns - Weights along the rows.
+   * @param rows - Weights along the columns.
+   */
+  static void resample(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination,
+                       const WeightTable &columns, const WeightTable &rows) {
+    int bands = (destination.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    size_t size = (size_t) destination.width * 4;
+
+    #pragma omp parallel
+    {
+      std::vector<float> pixels((size_t) source.width * 4), result(size), band;
+      std::vector<const float *> taps((size_t) rows.taps);
+
+      #pragma omp for schedule(dynamic)
+      for (int index = 0; index < bands; index++) {
+        int top = index * BAND_HEIGHT, bottom = std::min(top + BAND_HEIGHT, destination.height);
+        int first = rows.first[top], last = first;
+        for (int y = top; y < bottom; y++)
+          last = std::max(last, rows.first[y] + rows.count[y]);
+
+        // Source rows of the band resampled along the row, channels are widened to RGBX so a pixel fills a vector
+        band.resize((last - first) * size);
+        for (int y = first; y < last; y++) {
+          auto row = source.row(y);
+          for (int x = 0; x < source.width; x++) {
+            pixels[x * 4] = row[x].r;
+            pixels[x * 4 + 1] = row[x].g;
+            pixels[x * 4 + 2] = row[x].b;
+            pixels[x * 4 + 3] = 0.0f;
+          }
+          resampleRow(pixels.data(), columns, &band[(y - first) * size]);
+        }
+
+        for (int y = top; y < bottom; y++) {
+          for (int k = 0; k < rows.count[y]; k++)
+            taps[k] = &band[(rows.first[y] + k - first) * size];
+          sumRows(taps.data(), &rows.weights[(size_t) y * rows.taps], rows.count[y], (int) size, result.data());
+          auto row = destination.row(y);
+          for (int x = 0; x < destination.width; x++) {
+            uint8_t channels[3];
+            for (int c = 0; c < 3; c++) {
+              float value = result[x * 4 + c] + 0.5f;
+              channels[c] = !(value > 0.0f) ? 0 : value >= 255.0f ? 255 : (uint8_t) value;
+            }
+            row[x] = {channels[0], channels[1], channels[2]};
+          }
+        }
+      }
+    }
+  }
+
+  static void checkSize(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination,
+                        int width, int height) {
+    if (destination.width != width || destination.height != height || source.empty()) {
+      std::stringstream msg;
+      msg << "Cannot resample " << source.width << "x" << source.height << " pixels into " << destination.width << "x"
+          << destination.height << " pixels, expected " << width << "x" << height << ".";
+      throw std::runtime_error(msg.str());
+    }
+  }
+
+  void image::downsample(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination) {
+    checkSize(source, destination, std::max(source.width / 2, 1), std::max(source.height / 2, 1));
+    auto kernel = downsampleKernel();
+
+    #pragma omp parallel for
+    for (int y = 0; y < destination.height; y++) {
+      auto top = reinterpret_cast<const uint8_t *>(source.row(2 * y));
+      auto bottom = reinterpret_cast<const uint8_t *>(source.row(std::min(2 * y + 1, source.height - 1)));
+      auto row = reinterpret_cast<uint8_t *>(destination.row(y));
+      int done = kernel(top, bottom, row, source.width, destination.width);
+      downsampleScalar(top + done * 6, bottom + done * 6, row + done * 3, source.width - 2 * done, destination.width - done);
+    }
+  }
+
+  void image::resize(const ImageView<Image::Pixel> &source, const ImageSpan<Image::Pixel> &destination,
+                     ResampleFilter filter) {
+    if (source.empty() || destination.empty()) {
+      std::stringstream msg;
+      msg << "Cannot resample " << source.width << "x" << source.height << " pixels into " << destination.width << "x"
+          << destination.height << " pixels.";
+      throw std::runtime_error(msg.str());
+    }
+    resample(source, destination, filterWeights(source.width, destination.width, filter),
+             filterWeights(source.height, destination.height, filter));
+  }
+
+  Image image::resize(const ImageView<Image::Pixel> &source, int width, int height, ResampleFilter filter) {
+    Image result{width, height};
+    resize(source, result.span(), filter);
+    return result;
+  }
+
+  std::vector<Image> image::generateMipmaps(const ImageView<Image::Pixel> &image) {
+    std::vector<Image> levels;
+    ImageView<Image::Pixel> previous = image;
+    while (previous.width > 1 || previous.height > 1) {
+      Image level{std::max(previous.width / 2, 1), std::max(previous.height / 2, 1)};
+      downsample(previous, level.span());
+      levels.push_back(std::move(level));
+      previous = levels.back().view();
+    }
+    return levels;
+  }
+
+  std::vector<Image> image::gaussianPyramid(const ImageView<Image::Pixel> &image, int levels) {
+    std::vector<Image> pyramid;
+    ImageView<Image::Pixel> previous = image;
+    for (int i = 0; i < levels && (previous.width > 1 || previous.height > 1); i++) {
+      int width = (previous.width + 1) / 2, height = (previous.height + 1) / 2;
+      Image level{width, height};
+      resample(previous, level.span(), reduceWeights(previous.width, width), reduceWeights(previous.height, height));
+      pyramid.push_back(std::move(level));
+      previous = pyramid.back().view();
+    }
+    return pyramid;
+  }
+}
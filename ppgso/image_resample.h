@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+
+#include "image.h"
+
+namespace ppgso {
+  namespace image {
+
+/*!
+ * Filters of the resampling, wider filters are sharper and slower.
+ * Downscaling stretches the filter over the source pixels that fall into one destination pixel, so the result does not
+ * alias.
+ */
+  enum class ResampleFilter {
+    // Linear interpolation, one pixel on each side
+    Bilinear,
+    // Catmull-Rom cubic, two pixels on each side
+    Bicubic,
+    // Windowed sinc, three pixels on each side
+    Lanczos
+  };
+
+/*!
+ * Downsample to half the size by averaging 2x2 pixels, the results are rounded.
+ * The destination is max(width / 2, 1) by max(height / 2, 1) pixels, the last row or column of odd sizes is dropped
+ * except for images one pixel wide or high. Rows are processed in parallel.
+ *
+ * @param source - Pixels to downsample.
+ * @param destination - Pixels to write, half the size of the source.
+ */
+  void downsample(const ImageView<ppgso::Image::Pixel> &source, const ImageSpan<ppgso::Image::Pixel> &destination);
+
+/*!
+ * Resample to any size with a separable filter.
+ * Weights of the filter are computed once for all rows and columns, the rows of the destination are computed in
+ * parallel bands from the source rows they need.
+ *
+ * @param source - Pixels to resample.
+ * @param destination - Pixels to write, its size selects the scale.
+ * @param filter - Resampling filter.
+ */
+  void resize(const ImageView<ppgso::Image::Pixel> &source, const ImageSpan<ppgso::Image::Pixel> &destination,
+              ResampleFilter filter = ResampleFilter::Lanczos);
+
+/*!
+ * Resample to a new image of any size.
+ *
+ * @param source - Pixels to resample.
+ * @param width - Width of the result.
+ * @param height - Height of the result.
+ * @param filter - Resampling filter.
+ * @return - Resampled image.
+ */
+  ppgso::Image resize(const ImageView<ppgso::Image::Pixel> &source, int width, int height,
+                      ResampleFilter filter = ResampleFilter::Lanczos);
+
+/*!
+ * Generate the mip chain of an image with downsample, like glGenerateMipmap.
+ *
+ * @param image - Base level.
+ * @return - Levels below the base down to 1x1 pixels, the first one has half the size of the image.
+ */
+  std::vector<ppgso::Image> generateMipmaps(const ImageView<ppgso::Image::Pixel> &image);
+
+/*!
+ * Build a Gaussian pyramid, every level is blurred with the 5x5 binomial kernel and every other row and column is kept.
+ * A level of width w and height h is followed by one of (w + 1) / 2 by (h + 1) / 2 pixels, edges are clamped.
+ *
+ * @param image - Base level.
+ * @param levels - Number of levels to build below the base, they stop at 1x1 pixels.
+ * @return - Levels below the base.
+ */
+  std::vector<ppgso::Image> gaussianPyramid(const ImageView<ppgso::Image::Pixel> &image, int levels);
+  }
+}
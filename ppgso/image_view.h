@@ -0,0 +1,172 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+namespace ppgso {
+
+  /*!
+   * Non-owning reference to a rectangle of pixels in an image.
+   * Rows are stride bytes apart so a span can describe a whole image, a crop of it or a tile, all sharing the pixels
+   * of the image without copies. Left and top is the position of the span in the image it was created from.
+   *
+   * @tparam P - Pixel type, const for read only access.
+   */
+  template<typename P>
+  class ImageSpan {
+    // Byte type with the same constness as the pixels
+    using Byte = typename std::conditional<std::is_const<P>::value, const uint8_t, uint8_t>::type;
+
+  public:
+    /*!
+     * Pixels of a single row that can be used in range based for loops.
+     */
+    struct Row {
+      P *pixels;
+      int width;
+
+      P *begin() const { return pixels; }
+      P *end() const { return pixels + width; }
+      P &operator[](int x) const { return pixels[x]; }
+    };
+
+    /*!
+     * Range of the rows of a span.
+     */
+    class Rows {
+    public:
+      class iterator {
+      public:
+        iterator(const ImageSpan &span, int y) : span{span}, y{y} {}
+        Row operator*() const { return Row{span.row(y), span.width}; }
+        iterator &operator++() { y++; return *this; }
+        bool operator!=(const iterator &other) const { return y != other.y; }
+      private:
+        ImageSpan span;
+        int y;
+      };
+
+      explicit Rows(const ImageSpan &span) : span{span} {}
+      iterator begin() const { return {span, 0}; }
+      iterator end() const { return {span, span.height}; }
+    private:
+      ImageSpan span;
+    };
+
+    ImageSpan() = default;
+
+    /*!
+     * Create span of pixels.
+     *
+     * @param data - Pointer to the top left pixel.
+     * @param width - Width in pixels.
+     * @param height - Height in pixels.
+     * @param stride - Distance between rows in bytes.
+     * @param left - Horizontal position of the span in its image.
+     * @param top - Vertical position of the span in its image.
+     */
+    ImageSpan(P *data, int width, int height, size_t stride, int left = 0, int top = 0)
+        : data{data}, width{width}, height{height}, stride{stride}, left{left}, top{top} {}
+
+    /*!
+     * Read only spans can be created from writable ones.
+     */
+    template<typename Q, typename = typename std::enable_if<std::is_convertible<Q*, P*>::value>::type>
+    ImageSpan(const ImageSpan<Q> &other)
+        : data{other.data}, width{other.width}, height{other.height}, stride{other.stride}, left{other.left}, top{other.top} {}
+
+    /*!
+     * Get pointer to the first pixel of a row.
+     *
+     * @param y - Row index relative to the span.
+     * @return - Pointer to the row.
+     */
+    P *row(int y) const {
+      return reinterpret_cast<P*>(reinterpret_cast<Byte*>(data) + (size_t) y * stride);
+    }
+
+    /*!
+     * Get single pixel.
+     *
+     * @param x - X position relative to the span.
+     * @param y - Y position relative to the span.
+     * @return - Reference to the pixel.
+     */
+    P &operator()(int x, int y) const {
+      return row(y)[x];
+    }
+
+    /*!
+     * Get a rectangle of the span, the rectangle is limited to the span.
+     *
+     * @param x - X position of the rectangle relative to the span.
+     * @param y - Y position of the rectangle relative to the span.
+     * @param width - Width of the rectangle.
+     * @param height - Height of the rectangle.
+     * @return - Span sharing the pixels, empty if the rectangle is outside.
+     */
+    ImageSpan crop(int x, int y, int width, int height) const {
+      int x0 = std::max(x, 0), y0 = std::max(y, 0);
+      int x1 = std::min(x + width, this->width), y1 = std::min(y + height, this->height);
+      if (x1 <= x0 || y1 <= y0)
+        return ImageSpan{data, 0, 0, stride, left + x0, top + y0};
+      return ImageSpan{row(y0) + x0, x1 - x0, y1 - y0, stride, left + x0, top + y0};
+    }
+
+    /*!
+     * Iterate over the rows of the span.
+     *
+     * @return - Range of rows.
+     */
+    Rows rows() const {
+      return Rows{*this};
+    }
+
+    /*!
+     * Split the span into tiles, tiles on the right and bottom border may be smaller.
+     *
+     * @param tileWidth - Width of the tiles, positive.
+     * @param tileHeight - Height of the tiles, positive.
+     * @return - Tiles in row major order.
+     */
+    std::vector<ImageSpan> tiles(int tileWidth, int tileHeight) const {
+      if (tileWidth <= 0 || tileHeight <= 0) {
+        std::stringstream msg;
+        msg << "Tile size " << tileWidth << "x" << tileHeight << " is not positive.";
+        throw std::runtime_error(msg.str());
+      }
+      std::vector<ImageSpan> result;
+      for (int y = 0; y < height; y += tileHeight)
+        for (int x = 0; x < width; x += tileWidth)
+          result.push_back(crop(x, y, tileWidth, tileHeight));
+      return result;
+    }
+
+    /*!
+     * Check if the rows are stored without gaps.
+     *
+     * @return - True when the stride equals the row size.
+     */
+    bool isContiguous() const {
+      return stride == (size_t) width * sizeof(P);
+    }
+
+    bool empty() const {
+      return width <= 0 || height <= 0;
+    }
+
+    P *data = nullptr;
+    int width = 0, height = 0;
+    size_t stride = 0;
+    int left = 0, top = 0;
+  };
+
+  /*!
+   * Read only span of pixels.
+   */
+  template<typename P>
+  using ImageView = ImageSpan<const P>;
+}
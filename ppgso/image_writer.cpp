@@ -0,0 +1,144 @@
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+#include "image_writer.h"
+#include "image_bmp.h"
+#include "image_raw.h"
+#include "image_qoi.h"
+#include "image_ppm.h"
+
+namespace ppgso {
+
+  ImageWriter::ImageWriter(size_t capacity) : capacity{std::max<size_t>(capacity, 1)}, thread{&ImageWriter::run, this} {}
+
+  ImageWriter::~ImageWriter() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      done = true;
+    }
+    changed.notify_all();
+    thread.join();
+
+    // Destructors can not throw, report errors nobody asked for
+    if (error) {
+      try {
+        std::rethrow_exception(error);
+      } catch (const std::exception &e) {
+        std::cerr << "Could not write image. " << e.what() << std::endl;
+      }
+    }
+  }
+
+  void ImageWriter::write(Image image, const std::string &filename, Format format) {
+    enqueue({std::move(image), filename, resolve(filename, format)});
+  }
+
+  void ImageWriter::submit(Image &image, const std::string &filename, Format format) {
+    format = resolve(filename, format);
+
+    // Reuse the framebuffer of a written image of the same size when there is one
+    Image frame{0, 0};
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      auto match = std::find_if(recycled.begin(), recycled.end(), [&image](const Image &candidate) {
+        return candidate.width == image.width && candidate.height == image.height;
+      });
+      if (match != recycled.end()) {
+        frame = std::move(*match);
+        recycled.erase(match);
+      }
+    }
+    if (frame.width != image.width || frame.height != image.height)
+      frame = Image{image.width, image.height};
+
+    std::swap(frame, image);
+    enqueue({std::move(frame), filename, format});
+  }
+
+  void ImageWriter::flush() {
+    std::unique_lock<std::mutex> lock{mutex};
+    changed.wait(lock, [this] { return jobs.empty() && !writing; });
+    rethrow();
+  }
+
+  void ImageWriter::save(const ImageView<Image::Pixel> &view, const std::string &filename, Format format) {
+    switch (resolve(filename, format)) {
+      case Format::BMP:
+        image::saveBMP(view, filename);
+        break;
+      case Format::RAW:
+        image::saveRAW(view, filename);
+        break;
+      case Format::QOI:
+        image::saveQOI(view, filename);
+        break;
+      default:
+        image::savePPM(view, filename);
+        break;
+    }
+  }
+
+  ImageWriter::Format ImageWriter::resolve(const std::string &filename, Format format) {
+    if (format != Format::Auto)
+      return format;
+
+    auto dot = filename.find_last_of('.');
+    auto extension = dot == std::string::npos ? std::string{} : filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == "bmp") return Format::BMP;
+    if (extension == "raw") return Format::RAW;
+    if (extension == "qoi") return Format::QOI;
+    if (extension == "ppm") return Format::PPM;
+
+    std::stringstream msg;
+    msg << "Unknown image format of file " << filename;
+    throw std::runtime_error(msg.str());
+  }
+
+  void ImageWriter::enqueue(Job job) {
+    std::unique_lock<std::mutex> lock{mutex};
+    changed.wait(lock, [this] { return jobs.size() < capacity || error; });
+    rethrow();
+    jobs.push_back(std::move(job));
+    changed.notify_all();
+  }
+
+  void ImageWriter::rethrow() {
+    if (!error) return;
+    auto current = error;
+    error = nullptr;
+    std::rethrow_exception(current);
+  }
+
+  void ImageWriter::run() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true) {
+      changed.wait(lock, [this] { return !jobs.empty() || done; });
+      if (jobs.empty()) return;
+
+      auto job = std::move(jobs.front());
+      jobs.pop_front();
+      writing = true;
+      changed.notify_all();
+
+      // The job is owned by this thread while it is written
+      lock.unlock();
+      std::exception_ptr failure;
+      try {
+        save(job.image.view(), job.filename, job.format);
+      } catch (...) {
+        failure = std::current_exception();
+      }
+      lock.lock();
+
+      if (failure && !error)
+        error = failure;
+      if (recycled.size() < capacity)
+        recycled.push_back(std::move(job.image));
+      writing = false;
+      changed.notify_all();
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "image.h"
+
+namespace ppgso {
+
+  /*!
+   * Writes images to files on a background thread so renderers can compute the next image while the previous one is
+   * saved. Jobs are kept in a bounded queue, queueing an image waits while the queue is full so a fast renderer can not
+   * run ahead of the disk indefinitely. All queued images are written before the writer is destroyed.
+   *
+   * Errors of the background thread are reported by the next call to write, submit or flush.
+   */
+  class ImageWriter {
+  public:
+    /*!
+     * File formats, Auto picks the format from the file extension.
+     */
+    enum class Format {
+      Auto, BMP, RAW, QOI, PPM
+    };
+
+    /*!
+     * Start the writer thread.
+     *
+     * @param capacity - Maximum number of images waiting in the queue.
+     */
+    explicit ImageWriter(size_t capacity = 2);
+
+    /*!
+     * Write all queued images and stop the writer thread.
+     */
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter &operator=(const ImageWriter&) = delete;
+
+    /*!
+     * Queue an image for writing, move the image in to avoid a copy.
+     *
+     * @param image - Image to write, owned by the writer until it is written.
+     * @param filename - Name of the file to write the image to.
+     * @param format - Format of the file.
+     */
+    void write(Image image, const std::string &filename, Format format = Format::Auto);
+
+    /*!
+     * Queue the framebuffer of an image for writing without copying it. The image receives a framebuffer of the same
+     * size recycled from previously written images, its content is undefined and has to be cleared before rendering.
+     *
+     * @param image - Image to write, keeps its size.
+     * @param filename - Name of the file to write the image to.
+     * @param format - Format of the file.
+     */
+    void submit(Image &image, const std::string &filename, Format format = Format::Auto);
+
+    /*!
+     * Wait until all queued images are written.
+     */
+    void flush();
+
+    /*!
+     * Write a view to a file immediately.
+     *
+     * @param view - Pixels to write.
+     * @param filename - Name of the file to write the image to.
+     * @param format - Format of the file.
+     */
+    static void save(const ImageView<Image::Pixel> &view, const std::string &filename, Format format = Format::Auto);
+
+  private:
+    struct Job {
+      Image image;
+      std::string filename;
+      Format format;
+    };
+
+    size_t capacity;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Job> jobs;
+    std::vector<Image> recycled;
+    std::exception_ptr error;
+    bool writing = false;
+    bool done = false;
+    std::thread thread;
+
+    /*!
+     * Pick the format of a file.
+     *
+     * @param filename - Name of the file.
+     * @param format - Requested format, Auto uses the file extension.
+     * @return - Format to write the file in.
+     */
+    static Format resolve(const std::string &filename, Format format);
+
+    /*!
+     * Wait for a free place in the queue and queue a job.
+     *
+     * @param job - Job to queue.
+     */
+    void enqueue(Job job);
+
+    /*!
+     * Rethrow an error of the writer thread, must be called with the mutex locked.
+     */
+    void rethrow();
+
+    /*!
+     * Writer thread, writes queued images until the writer is destroyed.
+     */
+    void run();
+  };
+}
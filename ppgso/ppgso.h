@@ -7,8 +7,17 @@
 #include "mesh.h"
 #include "shader.h"
 #include "image.h"
+#include "image_buffer.h"
+#include "image_convert.h"
+#include "image_filter.h"
+#include "image_convolution.h"
+#include "image_resample.h"
+#include "image_compare.h"
 #include "image_bmp.h"
 #include "image_raw.h"
+#include "image_qoi.h"
+#include "image_ppm.h"
+#include "image_writer.h"
 #include "texture.h"
 #include "window.h"
 
@@ -1,6 +1,20 @@
 #include <iostream>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
 
 #include "texture.h"
+#include "image_resample.h"
+
+// Alignment of the streaming slots in bytes
+const size_t SLOT_ALIGNMENT = 256;
+
+// Number of mip levels of the texture storage
+const int MAX_LEVELS = 3;
+
+// Dirty rectangles are merged into their bounding box beyond this count
+const size_t MAX_DIRTY_REGIONS = 64;
 
 ppgso::Texture::Texture(int width, int height) : image{width, height} {
   initGL();
@@ -12,8 +26,45 @@ ppgso::Texture::Texture(Image&& image) : image{std::move(image)} {
   update();
 }
 
+ppgso::Texture::Texture(Texture&& other) : image{std::move(other.image)} {
+  moveFrom(other);
+}
+
+ppgso::Texture &ppgso::Texture::operator=(Texture&& other) {
+  if (this == &other) return *this;
+  releaseStreaming();
+  if (texture) glDeleteTextures(1, &texture);
+  image = std::move(other.image);
+  moveFrom(other);
+  return *this;
+}
+
 ppgso::Texture::~Texture() {
-  glDeleteTextures(1, &texture);
+  releaseStreaming();
+  if (texture) glDeleteTextures(1, &texture);
+}
+
+void ppgso::Texture::moveFrom(Texture &other) {
+  texture = other.texture;
+  levels = other.levels;
+  mipmaps = other.mipmaps;
+  dirty = std::move(other.dirty);
+  buffer = other.buffer;
+  fences = std::move(other.fences);
+  slotSize = other.slotSize;
+  slot = other.slot;
+  persistent = other.persistent;
+  writing = other.writing;
+
+  // The destructor of the moved from texture must not release the handles
+  other.texture = 0;
+  other.dirty.clear();
+  other.buffer = 0;
+  other.fences.clear();
+  other.slotSize = 0;
+  other.slot = 0;
+  other.persistent = nullptr;
+  other.writing = false;
 }
 
 void ppgso::Texture::initGL() {
@@ -21,8 +72,11 @@ void ppgso::Texture::initGL() {
   glGenTextures(1, &texture);
   glBindTexture(GL_TEXTURE_2D, texture);
 
-  // Reserve texture storage
-  glTexStorage2D(GL_TEXTURE_2D, 3, GL_RGB8, image.width, image.height);
+  // Reserve texture storage, small textures have fewer levels
+  levels = 1;
+  while (levels < MAX_LEVELS && std::max(image.width, image.height) >> levels > 0)
+    levels++;
+  glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGB8, image.width, image.height);
 
   // Set up mipmapping
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -35,12 +89,269 @@ void ppgso::Texture::initGL() {
 }
 
 void ppgso::Texture::update() {
+  if (dirty.empty()) {
+    update(image.view());
+    return;
+  }
+
+  auto regions = mergeDirty();
+  auto view = image.view();
+  if (buffer) {
+    // Only the dirty rectangles are copied to the ring
+    auto frame = beginUpdate();
+    for (auto &region : regions) {
+      for (int y = region.y; y < region.y + region.height; y++)
+        std::memcpy(frame.row(y) + region.x, view.row(y) + region.x, (size_t) region.width * sizeof(Image::Pixel));
+    }
+    writing = false;
+    submit(regions);
+    return;
+  }
+
+  bind();
+  upload(reinterpret_cast<uintptr_t>(view.data), (int) (view.stride / sizeof(Image::Pixel)), regions);
+  updateMipmaps(regions);
+}
+
+void ppgso::Texture::markDirty(int x, int y, int width, int height) {
+  int left = std::max(x, 0), top = std::max(y, 0);
+  int right = std::min(x + width, image.width), bottom = std::min(y + height, image.height);
+  if (left >= right || top >= bottom) return;
+
+  // Many small rectangles cost more uploads than their bounding box
+  if (dirty.size() == MAX_DIRTY_REGIONS) {
+    for (auto &region : dirty) {
+      left = std::min(left, region.x);
+      top = std::min(top, region.y);
+      right = std::max(right, region.x + region.width);
+      bottom = std::max(bottom, region.y + region.height);
+    }
+    dirty.clear();
+  }
+  dirty.push_back({left, top, right - left, bottom - top});
+}
+
+std::vector<ppgso::Texture::Region> ppgso::Texture::mergeDirty() {
+  auto regions = std::move(dirty);
+  dirty.clear();
+
+  // Replace overlapping or touching rectangles by their bounding box until none are left
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (size_t i = 0; i < regions.size(); i++) {
+      for (size_t j = i + 1; j < regions.size(); j++) {
+        auto &a = regions[i], &b = regions[j];
+        if (a.x > b.x + b.width || b.x > a.x + a.width || a.y > b.y + b.height || b.y > a.y + a.height)
+          continue;
+        int left = std::min(a.x, b.x), top = std::min(a.y, b.y);
+        int right = std::max(a.x + a.width, b.x + b.width), bottom = std::max(a.y + a.height, b.y + b.height);
+        a = {left, top, right - left, bottom - top};
+        regions.erase(regions.begin() + j);
+        j = i;
+        merged = true;
+      }
+    }
+  }
+
+  // Upload the whole image in one call when the rectangles cover most of it
+  size_t area = 0;
+  for (auto &region : regions)
+    area += (size_t) region.width * region.height;
+  if (area * 4 >= (size_t) image.width * image.height * 3)
+    return {{0, 0, image.width, image.height}};
+  return regions;
+}
+
+void ppgso::Texture::update(const ImageView<Image::Pixel> &view) {
+  if (view.width != image.width || view.height != image.height) {
+    std::stringstream msg;
+    msg << "Cannot update " << image.width << "x" << image.height << " texture with " << view.width << "x"
+        << view.height << " pixels.";
+    throw std::runtime_error(msg.str());
+  }
+
+  // The whole texture is replaced
+  dirty.clear();
+
+  // Streaming textures copy the pixels to the ring, the copy is cheaper than a synchronous upload
+  if (buffer) {
+    auto frame = beginUpdate();
+    for (int y = 0; y < view.height; y++)
+      std::memcpy(frame.row(y), view.row(y), (size_t) view.width * sizeof(Image::Pixel));
+    endUpdate();
+    return;
+  }
+
+  bind();
+  // Upload texture to GPU, OpenGL reads the rows directly when the stride is a whole number of pixels
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (view.stride % sizeof(Image::Pixel) == 0) {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) (view.stride / sizeof(Image::Pixel)));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, view.width, view.height, GL_RGB, GL_UNSIGNED_BYTE, view.data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  } else {
+    for (int y = 0; y < view.height; y++)
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, view.width, 1, GL_RGB, GL_UNSIGNED_BYTE, view.row(y));
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  updateMipmaps({{0, 0, image.width, image.height}});
+}
+
+void ppgso::Texture::upload(uintptr_t pixels, int rowLength, const std::vector<Region> &regions) {
+  // Rectangles are read in place from the rows of the image
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+  for (auto &region : regions) {
+    auto offset = ((size_t) region.y * rowLength + region.x) * sizeof(Image::Pixel);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, region.x, region.y, region.width, region.height, GL_RGB, GL_UNSIGNED_BYTE,
+                    reinterpret_cast<const void *>(pixels + offset));
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void ppgso::Texture::enableStreaming(int buffers) {
+  releaseStreaming();
+
+  // Slots hold tightly packed rows
+  size_t frameSize = (size_t) image.width * image.height * sizeof(Image::Pixel);
+  slotSize = (frameSize + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+  fences.assign((size_t) std::max(buffers, 1), nullptr);
+  slot = 0;
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  auto size = (GLsizeiptr) (slotSize * fences.size());
+  if (GLEW_ARB_buffer_storage) {
+    // Coherent mapping makes the writes visible to the GPU without flushing
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+    persistent = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    if (!persistent) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      releaseStreaming();
+      throw std::runtime_error("Failed to map texture streaming buffer!");
+    }
+  } else {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+ppgso::ImageSpan<ppgso::Image::Pixel> ppgso::Texture::beginUpdate() {
+  if (!buffer)
+    enableStreaming();
+  if (writing)
+    throw std::runtime_error("Texture update already started!");
+
+  // Wait until the GPU has copied the previous frame of this slot
+  auto &fence = fences[slot];
+  if (fence) {
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  uint8_t *pixels = nullptr;
+  if (persistent) {
+    pixels = persistent + slot * slotSize;
+  } else {
+    // The fence already guards the slot, so the driver does not have to synchronize the mapping
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    pixels = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, (GLintptr) (slot * slotSize),
+                                                     (GLsizeiptr) slotSize, GL_MAP_WRITE_BIT |
+                                                     GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!pixels)
+      throw std::runtime_error("Failed to map texture streaming buffer!");
+  }
+
+  writing = true;
+  return {reinterpret_cast<Image::Pixel *>(pixels), image.width, image.height,
+          (size_t) image.width * sizeof(Image::Pixel)};
+}
+
+void ppgso::Texture::endUpdate() {
+  if (!writing)
+    throw std::runtime_error("Texture update was not started!");
+  writing = false;
+  submit({{0, 0, image.width, image.height}});
+}
+
+void ppgso::Texture::submit(const std::vector<Region> &regions) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  if (!persistent)
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  // With a bound unpack buffer the pixel address is an offset into the buffer and the upload does not wait for the GPU
   bind();
-  // Upload texture to GPU
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGB, GL_UNSIGNED_BYTE, image.getFramebuffer().data());
+  upload(slot * slotSize, image.width, regions);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  updateMipmaps(regions);
+
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot = (slot + 1) % (int) fences.size();
+}
+
+void ppgso::Texture::setMipmaps(bool enabled) {
+  mipmaps = enabled;
+  bind();
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, enabled ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  updateMipmaps({{0, 0, image.width, image.height}});
+}
+
+void ppgso::Texture::updateMipmaps(const std::vector<Region> &regions) {
+  if (!mipmaps || levels == 1) return;
+  if (regions.size() == 1 && regions[0].width == image.width && regions[0].height == image.height) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+    return;
+  }
+
+  // Rectangles are aligned to the texels of the smallest level, so each level is averaged from the one above it alone
+  int scale = 1 << (levels - 1);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (auto &region : regions) {
+    int x0 = region.x / scale * scale, y0 = region.y / scale * scale;
+    int x1 = std::min((region.x + region.width + scale - 1) / scale * scale, image.width);
+    int y1 = std::min((region.y + region.height + scale - 1) / scale * scale, image.height);
+    auto source = image.view().crop(x0, y0, x1 - x0, y1 - y0);
+    Image previous{0, 0};
+    for (int level = 1; level < levels; level++) {
+      // Odd sizes drop the last row and column, a rectangle that only covers them does not change smaller levels
+      int left = x0 >> level, top = y0 >> level;
+      int right = std::min((x1 + (1 << level) - 1) >> level, std::max(image.width >> level, 1));
+      int bottom = std::min((y1 + (1 << level) - 1) >> level, std::max(image.height >> level, 1));
+      if (left >= right || top >= bottom) break;
+
+      Image mip{right - left, bottom - top};
+      image::downsample(source, mip.span());
+      glTexSubImage2D(GL_TEXTURE_2D, level, left, top, mip.width, mip.height, GL_RGB, GL_UNSIGNED_BYTE,
+                      mip.getFramebuffer().data());
+      previous = std::move(mip);
+      source = previous.view();
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
 
-  // Re-generate mipmaps
-  glGenerateMipmap(GL_TEXTURE_2D);
+void ppgso::Texture::releaseStreaming() {
+  for (auto &fence : fences) {
+    if (fence) glDeleteSync(fence);
+  }
+  fences.clear();
+  if (buffer) {
+    if (persistent) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+  }
+  buffer = 0;
+  persistent = nullptr;
+  writing = false;
 }
 
 void ppgso::Texture::bind(int id) const {
@@ -3,6 +3,7 @@
 #include <vector>
 #include <memory>
 #include <fstream>
+#include <cstdint>
 
 #include <GL/glew.h>
 
@@ -30,11 +31,75 @@ namespace ppgso {
 
     ~Texture();
 
+    Texture(const Texture&) = delete;
+    Texture &operator=(const Texture&) = delete;
+
+    /*!
+     * Take over the OpenGL texture and streaming buffers of another texture, the other texture is left empty.
+     *
+     * @param other - Texture to move from.
+     */
+    Texture(Texture&& other);
+    Texture &operator=(Texture&& other);
+
     /*!
      * Update the OpenGL texture in memory.
+     * When rectangles of the image were marked dirty only those are uploaded and only the mipmaps under them are
+     * recomputed, otherwise the whole image is uploaded.
      */
     void update();
 
+    /*!
+     * Mark a rectangle of the texture image as changed since the last update.
+     * Partial updates assume the image holds the pixels of the whole texture, do not mix them with update(view) or
+     * beginUpdate without a full update in between.
+     *
+     * @param x - Left column of the rectangle.
+     * @param y - Top row of the rectangle.
+     * @param width - Width of the rectangle, it is clipped to the image.
+     * @param height - Height of the rectangle, it is clipped to the image.
+     */
+    void markDirty(int x, int y, int width, int height);
+
+    /*!
+     * Update the OpenGL texture from pixels that are not stored in the texture image.
+     *
+     * @param view - Pixels to upload with the size of the texture, rows may be padded or part of a larger image.
+     */
+    void update(const ImageView<Image::Pixel> &view);
+
+    /*!
+     * Stream updates through a ring of pixel buffer objects so uploads do not stall the CPU.
+     * The CPU writes the next frame to one buffer while the GPU copies the previous frames from the others, a fence
+     * guards each buffer until the GPU has read it. Buffers stay mapped when the driver supports ARB_buffer_storage and
+     * are mapped for each frame otherwise. Once enabled, update copies the pixels to the ring too.
+     *
+     * @param buffers - Number of buffers in the ring, the number of frames that may be in flight at once.
+     */
+    void enableStreaming(int buffers = 3);
+
+    /*!
+     * Get the next streaming buffer to write a frame to, waits only while the GPU still reads that buffer.
+     * The pixels of the buffer are undefined, all of them have to be written and none should be read since the memory may
+     * be uncached. The texture image is not changed. Streaming is enabled with the default ring if needed.
+     *
+     * @return - Pixels of the frame with the size of the texture.
+     */
+    ImageSpan<Image::Pixel> beginUpdate();
+
+    /*!
+     * Upload the frame written to the span returned by beginUpdate, the GPU copies it to the texture asynchronously.
+     */
+    void endUpdate();
+
+    /*!
+     * Select if mipmaps are regenerated after each update, textures displayed at their size do not need them.
+     * Without mipmaps the texture is minified with linear filtering of the base level.
+     *
+     * @param enabled - True to regenerate mipmaps, the default.
+     */
+    void setMipmaps(bool enabled);
+
     /*!
      * Get OpenGL texture identifier number.
      *
@@ -51,8 +116,70 @@ namespace ppgso {
 
     Image image;
   private:
+    /*!
+     * Rectangle of the texture in pixels.
+     */
+    struct Region {
+      int x, y, width, height;
+    };
+
     void initGL();
-    GLuint texture;
+
+    /*!
+     * Merge overlapping and touching dirty rectangles, rectangles covering most of the image become a single one.
+     *
+     * @return - Rectangles to upload.
+     */
+    std::vector<Region> mergeDirty();
+
+    /*!
+     * Upload rectangles of client memory or of the bound unpack buffer to the base level of the bound texture.
+     *
+     * @param pixels - Address of the top left pixel of the image, an offset when an unpack buffer is bound.
+     * @param rowLength - Distance between rows in pixels.
+     * @param regions - Rectangles to upload.
+     */
+    void upload(uintptr_t pixels, int rowLength, const std::vector<Region> &regions);
+
+    /*!
+     * Upload the rectangles of the current streaming buffer and move to the next buffer of the ring.
+     *
+     * @param regions - Rectangles written to the buffer.
+     */
+    void submit(const std::vector<Region> &regions);
+
+    /*!
+     * Recompute mipmaps of the bound texture under the regions if they are enabled, from the pixels of the image.
+     *
+     * @param regions - Rectangles of the base level that changed.
+     */
+    void updateMipmaps(const std::vector<Region> &regions);
+
+    /*!
+     * Unmap and delete the streaming buffers.
+     */
+    void releaseStreaming();
+
+    /*!
+     * Take over the handles and state of another texture and reset the handles of the other one.
+     *
+     * @param other - Texture to move from.
+     */
+    void moveFrom(Texture &other);
+
+    GLuint texture = 0;
+    int levels = 1;
+    bool mipmaps = true;
+    std::vector<Region> dirty;
+
+    // Streaming ring, one buffer object split into slots of slotSize bytes with a fence per slot
+    GLuint buffer = 0;
+    std::vector<GLsync> fences;
+    size_t slotSize = 0;
+    int slot = 0;
+    // Base of the persistently mapped buffer, null when slots are mapped for each frame
+    uint8_t *persistent = nullptr;
+    bool writing = false;
   };
 }
 
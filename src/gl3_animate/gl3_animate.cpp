@@ -2,6 +2,8 @@
 // - Demonstrates the use of a dynamically generated texture content on the CPU
 // - Displays the generated content as texture on a quad using OpenGL
 // - Basic animation achieved by incrementing a parameter used in the image generation
+// - Frames are generated directly into a ring of pixel buffers, the GPU uploads the previous frame while the CPU
+//   generates the next one
 
 #include <iostream>
 #include <cmath>
@@ -34,25 +36,27 @@ private:
    * @param time Time to generate animation frame for
    */
   void updateTexture(ppgso::Texture &texture, double time) {
-    // Draw something to the texture
+    // Draw something to the next streaming buffer of the texture
     double cx = sin(time);
     double cy = cos(time * 0.9);
+    auto frame = texture.beginUpdate();
 
     #pragma omp parallel for
-    for (int y = 0; y < texture.image.height; y++) {
-      for (int x = 0; x < texture.image.width; x++) {
-        auto& pixel = texture.image.getPixel(x, y);
-        double fx = (float) x / (float) (texture.image.width) - .5;
-        double fy = (float) y / (float) (texture.image.height) - .5;
+    for (int y = 0; y < frame.height; y++) {
+      auto row = frame.row(y);
+      for (int x = 0; x < frame.width; x++) {
+        double fx = (float) x / (float) (frame.width) - .5;
+        double fy = (float) y / (float) (frame.height) - .5;
         double dist = sqrt(pow(fx - cx, 2.0) + pow(fy - cy, 2.0));
 
-        pixel.r = (uint8_t) (sin(dist * 45.0) * 127 + 128);
-        pixel.g = (uint8_t) (sin(dist * 44.0) * 127 + 128);
-        pixel.b = (uint8_t) (sin(dist * 46.0) * 127 + 128);
+        // Write whole pixels, the buffer memory is uncached
+        row[x] = {(uint8_t) (sin(dist * 45.0) * 127 + 128),
+                  (uint8_t) (sin(dist * 44.0) * 127 + 128),
+                  (uint8_t) (sin(dist * 46.0) * 127 + 128)};
       }
     }
-    // Update the OpenGL texture content
-    texture.update();
+    // Upload the frame, the GPU copies it while the next frame is generated
+    texture.endUpdate();
   }
 
 public:
@@ -60,6 +64,10 @@ public:
    * Construct a new Window and initialize shader uniform variables
    */
   AnimateWindow() : ppgso::Window{"gl3_animate", SIZE, SIZE} {
+    // The quad shows the texture at its size so mipmaps are not needed
+    texture.setMipmaps(false);
+    texture.enableStreaming();
+
     // Pass the texture to the program as uniform input called "Texture"
     program.setUniform("Texture", texture);
 
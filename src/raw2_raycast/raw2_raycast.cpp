@@ -217,6 +217,7 @@ struct World {
    */
   void render(ppgso::Image& image, unsigned int samples) const {
     // Render section of the framebuffer
+    std::vector<float> row(image.width * 3);
     for(int y = 0; y < image.height; ++y) {
       for (int x = 0; x < image.width; ++x) {
         glm::dvec3 color{};
@@ -225,8 +226,12 @@ struct World {
           color = color + trace(ray);
         }
         color = color / (double) samples;
-        image.setPixel(x, y, (float) color.r, (float) color.g, (float) color.b);
+        row[x * 3] = (float) color.r;
+        row[x * 3 + 1] = (float) color.g;
+        row[x * 3 + 2] = (float) color.b;
       }
+      // Convert the whole row to the image at once
+      ppgso::image::convertRow(row.data(), &image.getPixel(0, y), image.width);
     }
   }
 };
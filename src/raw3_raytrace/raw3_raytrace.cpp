@@ -215,9 +215,10 @@ struct World {
    * @param image Image to render to
    */
   void render(ppgso::Image& image, unsigned int samples, unsigned int depth) const {
-    // For each pixel generate rays
+    // For each pixel generate rays, whole rows are converted to the image at once
     #pragma omp parallel for
     for (int y = 0; y < image.height; ++y) {
+      std::vector<float> row(image.width * 3);
       for (int x = 0; x < image.width; ++x) {
         glm::dvec3 color{};
 
@@ -228,8 +229,11 @@ struct World {
         }
         // Collect the data
         color = color / (double) samples;
-        image.setPixel(x, y, (float)color.r, (float)color.g, (float)color.b);
+        row[x * 3] = (float) color.r;
+        row[x * 3 + 1] = (float) color.g;
+        row[x * 3 + 2] = (float) color.b;
       }
+      ppgso::image::convertRow(row.data(), &image.getPixel(0, y), image.width);
     }
   }
 };
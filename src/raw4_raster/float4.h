@@ -0,0 +1,187 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLOAT4_SSE
+#include <emmintrin.h>
+#endif
+
+/*!
+ * Four floats processed together, the rasterizer uses one lane per fragment of a 2x2 quad
+ * Operations map to SSE instructions when available, other platforms use a plain array
+ */
+struct float4 {
+#ifdef FLOAT4_SSE
+  __m128 v;
+
+  float4() = default;
+  float4(__m128 v) : v{v} {}
+  float4(float x) : v{_mm_set1_ps(x)} {}
+  float4(float x, float y, float z, float w) : v{_mm_setr_ps(x, y, z, w)} {}
+
+  float operator[](int i) const {
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, v);
+    return lanes[i];
+  }
+
+  void store(float *lanes) const { _mm_storeu_ps(lanes, v); }
+
+  friend float4 operator+(const float4 &a, const float4 &b) { return _mm_add_ps(a.v, b.v); }
+  friend float4 operator-(const float4 &a, const float4 &b) { return _mm_sub_ps(a.v, b.v); }
+  friend float4 operator*(const float4 &a, const float4 &b) { return _mm_mul_ps(a.v, b.v); }
+  friend float4 operator/(const float4 &a, const float4 &b) { return _mm_div_ps(a.v, b.v); }
+  friend float4 min(const float4 &a, const float4 &b) { return _mm_min_ps(a.v, b.v); }
+  friend float4 max(const float4 &a, const float4 &b) { return _mm_max_ps(a.v, b.v); }
+  friend float4 sqrt(const float4 &a) { return _mm_sqrt_ps(a.v); }
+
+  /*!
+   * Compare lanes
+   * @return Bit mask with bit i set when a[i] <= b[i]
+   */
+  friend int lessThanEqual(const float4 &a, const float4 &b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+
+  /*!
+   * Compare lanes
+   * @return Bit mask with bit i set when a[i] >= b[i]
+   */
+  friend int greaterThanEqual(const float4 &a, const float4 &b) { return _mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)); }
+
+  /*!
+   * Convert lanes to bytes, values are truncated and saturated to <0, 255>
+   * @return Byte i holds lane i
+   */
+  friend uint32_t packBytes(const float4 &a) {
+    __m128i i32 = _mm_cvttps_epi32(a.v);
+    __m128i i16 = _mm_packs_epi32(i32, i32);
+    return (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(i16, i16));
+  }
+
+  /*!
+   * Transpose four vectors as if they were rows of a 4x4 matrix
+   */
+  friend void transpose(float4 &a, float4 &b, float4 &c, float4 &d) {
+    _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+  }
+#else
+  float v[4];
+
+  float4() = default;
+  float4(float x) : v{x, x, x, x} {}
+  float4(float x, float y, float z, float w) : v{x, y, z, w} {}
+
+  float operator[](int i) const { return v[i]; }
+
+  void store(float *lanes) const { std::copy_n(v, 4, lanes); }
+
+  friend float4 operator+(const float4 &a, const float4 &b) { return {a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}; }
+  friend float4 operator-(const float4 &a, const float4 &b) { return {a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}; }
+  friend float4 operator*(const float4 &a, const float4 &b) { return {a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}; }
+  friend float4 operator/(const float4 &a, const float4 &b) { return {a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]}; }
+  friend float4 min(const float4 &a, const float4 &b) { return {std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3])}; }
+  friend float4 max(const float4 &a, const float4 &b) { return {std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3])}; }
+  friend float4 sqrt(const float4 &a) { return {std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3])}; }
+
+  friend int lessThanEqual(const float4 &a, const float4 &b) {
+    return (a.v[0] <= b.v[0]) | (a.v[1] <= b.v[1]) << 1 | (a.v[2] <= b.v[2]) << 2 | (a.v[3] <= b.v[3]) << 3;
+  }
+
+  friend int greaterThanEqual(const float4 &a, const float4 &b) {
+    return (a.v[0] >= b.v[0]) | (a.v[1] >= b.v[1]) << 1 | (a.v[2] >= b.v[2]) << 2 | (a.v[3] >= b.v[3]) << 3;
+  }
+
+  friend uint32_t packBytes(const float4 &a) {
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++)
+      result |= (uint32_t) std::min(std::max((int) a.v[i], 0), 255) << (8 * i);
+    return result;
+  }
+
+  friend void transpose(float4 &a, float4 &b, float4 &c, float4 &d) {
+    std::swap(a.v[1], b.v[0]);
+    std::swap(a.v[2], c.v[0]);
+    std::swap(a.v[3], d.v[0]);
+    std::swap(b.v[2], c.v[1]);
+    std::swap(b.v[3], d.v[1]);
+    std::swap(c.v[3], d.v[2]);
+  }
+#endif
+
+  /*!
+   * Clamp lanes to a range
+   * @param a Value to clamp
+   * @param low Lower bound
+   * @param high Upper bound
+   * @return Clamped value
+   */
+  friend float4 clamp(const float4 &a, const float4 &low, const float4 &high) { return min(max(a, low), high); }
+
+  /*!
+   * Linear interpolation of lanes
+   * @param a First value
+   * @param b Second value
+   * @param t Interpolation amount, range <0,1>
+   * @return Linear combination of a and b
+   */
+  friend float4 lerp(const float4 &a, const float4 &b, const float4 &t) { return a + (b - a) * t; }
+};
+
+/*!
+ * Convert bytes to lanes, inverse of packBytes
+ * @param bytes Byte i holds lane i
+ * @return Lanes in range <0, 255>
+ */
+inline float4 unpackBytes(uint32_t bytes) {
+#ifdef FLOAT4_SSE
+  __m128i zero = _mm_setzero_si128();
+  __m128i i16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) bytes), zero);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(i16, zero));
+#else
+  return {(float) (bytes & 0xff), (float) (bytes >> 8 & 0xff), (float) (bytes >> 16 & 0xff), (float) (bytes >> 24)};
+#endif
+}
+
+/*!
+ * Four 32 bit integers processed together, the rasterizer uses them for the fixed point edge functions of a 2x2 quad
+ */
+struct int4 {
+#ifdef FLOAT4_SSE
+  __m128i v;
+
+  int4() = default;
+  int4(__m128i v) : v{v} {}
+  int4(int x) : v{_mm_set1_epi32(x)} {}
+  int4(int x, int y, int z, int w) : v{_mm_setr_epi32(x, y, z, w)} {}
+
+  friend int4 operator+(const int4 &a, const int4 &b) { return _mm_add_epi32(a.v, b.v); }
+  friend int4 operator|(const int4 &a, const int4 &b) { return _mm_or_si128(a.v, b.v); }
+
+  /*!
+   * Extract sign bits
+   * @return Bit mask with bit i set when a[i] < 0
+   */
+  friend int signMask(const int4 &a) { return _mm_movemask_ps(_mm_castsi128_ps(a.v)); }
+
+  /*!
+   * Convert lanes to floats
+   */
+  friend float4 toFloat(const int4 &a) { return _mm_cvtepi32_ps(a.v); }
+#else
+  int v[4];
+
+  int4() = default;
+  int4(int x) : v{x, x, x, x} {}
+  int4(int x, int y, int z, int w) : v{x, y, z, w} {}
+
+  friend int4 operator+(const int4 &a, const int4 &b) { return {a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}; }
+  friend int4 operator|(const int4 &a, const int4 &b) { return {a.v[0] | b.v[0], a.v[1] | b.v[1], a.v[2] | b.v[2], a.v[3] | b.v[3]}; }
+
+  friend int signMask(const int4 &a) {
+    return (a.v[0] < 0) | (a.v[1] < 0) << 1 | (a.v[2] < 0) << 2 | (a.v[3] < 0) << 3;
+  }
+
+  friend float4 toFloat(const int4 &a) { return {(float) a.v[0], (float) a.v[1], (float) a.v[2], (float) a.v[3]}; }
+#endif
+};
@@ -0,0 +1,881 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#include <ppgso/ppgso.h>
+
+#include "float4.h"
+
+/*!
+ * Vertex structure to hold per vertex data in
+ */
+struct Vertex {
+  glm::vec4 position;
+  glm::vec4 normal;
+  glm::vec2 texCoord;
+  glm::vec4 color;
+};
+
+/*!
+ * Face structure to hold indices of three vertices that form a triangle/face
+ */
+struct Face {
+  unsigned int v0, v1, v2;
+};
+
+/*!
+ * Indexed mesh, faces reference the vertices so shared vertices are stored and processed only once
+ */
+struct Mesh {
+  std::vector<Vertex> vertices;
+  std::vector<Face> faces;
+};
+
+/*!
+ * Output colors of a 2x2 quad of fragments, one float4 lane per fragment
+ */
+struct QuadColor {
+  float4 r, g, b;
+};
+
+/*!
+ * Point light used by the lighting pass of deferred shading, the light has no effect beyond radius
+ */
+struct PointLight {
+  glm::vec3 position;
+  glm::vec3 color;
+  float radius;
+};
+
+// Size of the square screen tiles used for binning, in pixels
+const int TILE_SIZE = 64;
+
+// Size of the square blocks of pixels tracked by the coarse depth buffer, has to divide TILE_SIZE
+const int BLOCK_SIZE = 8;
+
+// Number of faces culled and clipped together in one batch
+const int BATCH_SIZE = 256;
+
+// Size of the guard band relative to the viewport, triangles are clipped to the screen sides only when they leave it
+const float GUARD_BAND = 4.0f;
+
+// Number of clipping planes, near and far followed by left, right, bottom and top
+const int CLIP_PLANES = 6;
+
+// Maximum number of vertices of a triangle clipped by all planes
+const int CLIP_VERTICES = 3 + CLIP_PLANES;
+
+// Vertex positions are snapped to fixed point with this many fractional bits before rasterization
+const int SUBPIXEL_BITS = 8;
+
+// Limit of the fixed point edge functions at the start of a block, larger values have the same sign in the whole block
+// Blocks that hit the limit use it for coverage only, their barycentric coordinates are evaluated without it
+const int64_t EDGE_LIMIT = 1 << 29;
+
+/*!
+ * Coarse depth of a block of BLOCK_SIZE x BLOCK_SIZE pixels
+ * Depth only decreases so the nearest value is kept up to date on every write, the farthest value is recomputed from the
+ * depth buffer when it is needed and the block was written to since
+ */
+struct DepthBlock {
+  float nearest, farthest;
+  bool stale;
+};
+
+/*!
+ * Rectangular render target the rasterizer writes fragments to
+ * Depth, color and surfaces point to the pixel at x0, y0 and rows are stride pixels apart
+ * Surfaces hold the planes of the G-buffer used by deferred shading, planes are planeSize floats apart
+ * Blocks point to the coarse depth of the block at x0, y0 and rows are blockStride blocks apart
+ */
+struct Tile {
+  int x0, y0, x1, y1;
+  int stride;
+  float *depth;
+  ppgso::Image::Pixel *color;
+  float *surfaces;
+  int planeSize;
+  int blockStride;
+  DepthBlock *blocks;
+};
+
+/*!
+ * Simple rasterizer class that can render triangles into an image
+ * The rasterizer is specialized for a shader program at compile time, the program has to provide:
+ * - template<typename T> struct Varying - varying data with members of type T only, interpolated per fragment
+ * - glm::vec4 vertexShader(const Vertex &vertex, Varying<float> &varying) - returns the position in clip space
+ * - QuadColor fragmentShader(const Varying<float4> &varying) - shades a 2x2 quad of fragments
+ * Interpolation and shading is generated for the exact varying data of the program and all shader calls are inlined.
+ *
+ * Deferred shading is used when the fragment shader returns Surface<float4> instead of QuadColor, render then only
+ * fills the G-buffer and lightingPass computes the image. The program additionally has to provide:
+ * - template<typename T> struct Surface - surface data with members of type T only, stored in one G-buffer plane each
+ * - QuadColor lightingShader(const Surface<float4> &surface, const float4 &x, const float4 &y, const float4 &z,
+ *   const std::vector<const PointLight*> &lights) - shades a 2x2 quad of pixels at world positions x, y, z
+ * - std::vector<PointLight> lights, glm::mat4 viewMatrix and glm::mat4 projectionMatrix
+ */
+template<typename Program>
+class Rasterizer {
+private:
+  // Varying data of a single vertex and of a 2x2 quad of fragments
+  using Varying = typename Program::template Varying<float>;
+  using QuadVarying = typename Program::template Varying<float4>;
+
+  // Number of interpolated values
+  static const int VARYINGS = sizeof(Varying) / sizeof(float);
+  static_assert(sizeof(Varying) == VARYINGS * sizeof(float) && sizeof(QuadVarying) == VARYINGS * sizeof(float4),
+                "Program::Varying<T> has to consist of members of type T only");
+
+  // Fragment shader output, QuadColor for forward shading or the surface data written to the G-buffer
+  using Output = decltype(std::declval<Program&>().fragmentShader(std::declval<const QuadVarying&>()));
+
+  // Number of G-buffer planes, zero for forward shading
+  static const int SURFACES = std::is_same<Output, QuadColor>::value ? 0 : sizeof(Output) / sizeof(float4);
+  static_assert(SURFACES * sizeof(float4) == sizeof(Output) || SURFACES == 0,
+                "Program::Surface<T> has to consist of members of type T only");
+
+  /*!
+   * Vertex shader output, position in clip or viewport coordinates and the varying data of the program
+   */
+  struct ShadedVertex {
+    glm::vec4 position;
+    Varying varying;
+  };
+
+  /*!
+   * Triangle after vertex processing, vertices are in viewport coordinates with 1/w stored in position.w
+   * Edge i is opposite to vertex i, its fixed point function edgeA[i] * x + edgeB[i] * y + edgeC[i] for the pixel at x, y
+   * is non-negative exactly when the pixel center is covered according to the top-left fill rule
+   * Adding edgeOffset[i] to the function and multiplying by invArea gives the barycentric coordinate of vertex i
+   * The bounding box is in pixels and inclusive, nearest and farthest is the depth range of the vertices
+   */
+  struct Triangle {
+    ShadedVertex v0, v1, v2;
+    int edgeA[3], edgeB[3];
+    int64_t edgeC[3];
+    glm::vec3 edgeOffset;
+    float invArea;
+    float nearest, farthest;
+    int minX, minY, maxX, maxY;
+  };
+
+  /*!
+   * Vertex shader outputs of a mesh stored as structure of arrays, faces reference them using the mesh indices
+   */
+  struct ShadedVertices {
+    std::vector<glm::vec4> positions;
+    std::vector<Varying> varyings;
+
+    /*!
+     * Gather a shaded vertex
+     * @param i Vertex index
+     * @return Vertex shader output
+     */
+    ShadedVertex get(unsigned int i) const {
+      return ShadedVertex{positions[i], varyings[i]};
+    }
+  };
+
+  Program &program;
+  ppgso::Image &image;
+  // Matrix that aligns the screen coordinates to viewport coordinates
+  glm::mat4 viewportMatrix;
+  std::vector<float> depthBuffer;
+  std::vector<float> surfaceBuffer;
+  ShadedVertices shaded;
+
+  // Triangles of each batch of faces and the triangles binned to each tile, kept to reuse their storage between frames
+  std::vector<std::vector<Triangle>> batches;
+  std::vector<std::vector<const Triangle*>> bins;
+
+  /*!
+   * Vertex interpolation function used for clipping, all data is interpolated linearly in clip space
+   * @param v0 First vertex
+   * @param v1 Second vertex
+   * @param t Interpolation amount, range <0,1>
+   * @return Linear combination of v0 and v1
+   */
+  static ShadedVertex lerp(const ShadedVertex &v0, const ShadedVertex &v1, float t) {
+    ShadedVertex result{glm::lerp(v0.position, v1.position, t), {}};
+    auto a = reinterpret_cast<const float*>(&v0.varying);
+    auto b = reinterpret_cast<const float*>(&v1.varying);
+    auto output = reinterpret_cast<float*>(&result.varying);
+    for (int i = 0; i < VARYINGS; i++)
+      output[i] = glm::lerp(a[i], b[i], t);
+    return result;
+  }
+
+  /*!
+   * Transform a vertex from screen coordinates to viewport/image coordinates
+   * @param vertex Vertex to transform to viewport. The visible range is <-1,1> for x and y coordinates
+   * @return Vertex that has position transformed to viewport/image coordinates, position.w holds 1/w for perspective correction
+   */
+  ShadedVertex toViewport(const ShadedVertex &vertex) {
+    // First convert homogeneous coordinates to cartesian and transform to viewport
+    glm::vec4 viewportCoordinates = viewportMatrix * (vertex.position / vertex.position.w);
+    viewportCoordinates.w = 1.0f / vertex.position.w;
+    // Copy rest of the data without change
+    return ShadedVertex{viewportCoordinates, vertex.varying};
+  }
+
+  /*!
+   * Interpolate, depth test and shade a 2x2 quad of fragments and write the visible ones to the output
+   * @param tile Render target
+   * @param triangle Triangle the quad belongs to
+   * @param x Horizontal position of the top left fragment
+   * @param y Vertical position of the top left fragment
+   * @param e0 Edge function values opposite to vertex v0
+   * @param e1 Edge function values opposite to vertex v1
+   * @param e2 Edge function values opposite to vertex v2
+   * @param mask Bit mask of fragments inside of the triangle and the tile
+   * @param block Coarse depth of the block the quad is in
+   * @param depthTest False when the whole triangle is known to be in front of the block
+   */
+  void renderQuad(const Tile &tile, const Triangle &triangle, int x, int y, const float4 &e0, const float4 &e1, const float4 &e2, int mask, DepthBlock &block, bool depthTest) {
+    auto &v0 = triangle.v0;
+    auto &v1 = triangle.v1;
+    auto &v2 = triangle.v2;
+
+    // Barycentric coordinates, depth is interpolated linearly in screen space
+    float4 b0 = e0 * triangle.invArea;
+    float4 b1 = e1 * triangle.invArea;
+    float4 b2 = e2 * triangle.invArea;
+    float4 z = b0 * v0.position.z + b1 * v1.position.z + b2 * v2.position.z;
+
+    // Depth test, only covered fragments are read from the depth buffer
+    int offset = (x - tile.x0) + (y - tile.y0) * tile.stride;
+    const int offsets[4] = {offset, offset + 1, offset + tile.stride, offset + tile.stride + 1};
+    if (depthTest) {
+      float stored[4];
+      for (int i = 0; i < 4; i++)
+        stored[i] = mask & (1 << i) ? tile.depth[offsets[i]] : 0;
+      mask &= lessThanEqual(z, float4{stored[0], stored[1], stored[2], stored[3]});
+      if (!mask) return;
+    }
+
+    // Perspective correct weights of v1 and v2
+    float4 w = b0 * v0.position.w + b1 * v1.position.w + b2 * v2.position.w;
+    float4 p1 = b1 * v1.position.w / w;
+    float4 p2 = b2 * v2.position.w / w;
+    QuadVarying varying;
+    auto a0 = reinterpret_cast<const float*>(&v0.varying);
+    auto a1 = reinterpret_cast<const float*>(&v1.varying);
+    auto a2 = reinterpret_cast<const float*>(&v2.varying);
+    auto output = reinterpret_cast<float4*>(&varying);
+    for (int i = 0; i < VARYINGS; i++)
+      output[i] = float4{a0[i]} + p1 * (a1[i] - a0[i]) + p2 * (a2[i] - a0[i]);
+
+    // Shade the fragments and write the visible ones
+    write(tile, offsets, mask, program.fragmentShader(varying));
+    float depth[4];
+    z.store(depth);
+    for (int i = 0; i < 4; i++) {
+      if (!(mask & (1 << i))) continue;
+      tile.depth[offsets[i]] = depth[i];
+      block.nearest = std::min(block.nearest, depth[i]);
+    }
+    block.stale = true;
+  }
+
+  /*!
+   * Limit fragment colors and write the visible ones to the color buffer
+   * @param tile Render target
+   * @param offsets Offsets of the quad fragments in the tile
+   * @param mask Bit mask of visible fragments
+   * @param color Fragment colors
+   */
+  static void write(const Tile &tile, const int *offsets, int mask, const QuadColor &color) {
+    uint32_t r = packBytes(clamp(color.r, 0.0f, 1.0f) * 255.0f);
+    uint32_t g = packBytes(clamp(color.g, 0.0f, 1.0f) * 255.0f);
+    uint32_t b = packBytes(clamp(color.b, 0.0f, 1.0f) * 255.0f);
+    for (int i = 0; i < 4; i++) {
+      if (mask & (1 << i))
+        tile.color[offsets[i]] = {(uint8_t) (r >> 8 * i), (uint8_t) (g >> 8 * i), (uint8_t) (b >> 8 * i)};
+    }
+  }
+
+  /*!
+   * Write surface data of the visible fragments to the G-buffer planes, each member of the surface has its own plane
+   * @param tile Render target
+   * @param offsets Offsets of the quad fragments in the tile
+   * @param mask Bit mask of visible fragments
+   * @param surface Fragment surface data
+   */
+  template<typename Surface>
+  static void write(const Tile &tile, const int *offsets, int mask, const Surface &surface) {
+    auto input = reinterpret_cast<const float4*>(&surface);
+    for (int p = 0; p < SURFACES; p++) {
+      float values[4];
+      input[p].store(values);
+      float *plane = tile.surfaces + p * tile.planeSize;
+      for (int i = 0; i < 4; i++) {
+        if (mask & (1 << i))
+          plane[offsets[i]] = values[i];
+      }
+    }
+  }
+
+  /*!
+   * Compute the coarse depth of a block from the depth buffer
+   * @param tile Render target the block belongs to
+   * @param bx Horizontal block position relative to the tile
+   * @param by Vertical block position relative to the tile
+   */
+  static void updateBlock(const Tile &tile, int bx, int by) {
+    auto &block = tile.blocks[bx + by * tile.blockStride];
+    int width = std::min(BLOCK_SIZE, tile.x1 - tile.x0 - bx * BLOCK_SIZE);
+    int height = std::min(BLOCK_SIZE, tile.y1 - tile.y0 - by * BLOCK_SIZE);
+    block.nearest = std::numeric_limits<float>::max();
+    block.farthest = std::numeric_limits<float>::lowest();
+    for (int y = 0; y < height; y++) {
+      auto row = &tile.depth[bx * BLOCK_SIZE + (by * BLOCK_SIZE + y) * tile.stride];
+      for (int x = 0; x < width; x++) {
+        block.nearest = std::min(block.nearest, row[x]);
+        block.farthest = std::max(block.farthest, row[x]);
+      }
+    }
+    block.stale = false;
+  }
+
+  /*!
+   * Compute the coarse depth of all blocks of a render target
+   * @param tile Render target to update
+   */
+  static void updateBlocks(const Tile &tile) {
+    for (int by = 0; by * BLOCK_SIZE < tile.y1 - tile.y0; by++)
+      for (int bx = 0; bx * BLOCK_SIZE < tile.x1 - tile.x0; bx++)
+        updateBlock(tile, bx, by);
+  }
+
+  /*!
+   * Compute distance of a clip space position to a clipping plane
+   * @param position Position in clip space
+   * @param plane Index of the plane, see CLIP_PLANES
+   * @param extent Extent of the side planes, 1 for the viewport and GUARD_BAND for the guard band
+   * @return Signed distance, positive values are inside
+   */
+  static float planeDistance(const glm::vec4 &position, int plane, float extent) {
+    switch (plane) {
+      case 0: return position.w + position.z;
+      case 1: return position.w - position.z;
+      case 2: return extent * position.w + position.x;
+      case 3: return extent * position.w - position.x;
+      case 4: return extent * position.w + position.y;
+      default: return extent * position.w - position.y;
+    }
+  }
+
+  /*!
+   * Compute outcode of a clip space position
+   * @param position Position in clip space
+   * @param extent Extent of the side planes, 1 for the viewport and GUARD_BAND for the guard band
+   * @return Bit mask of planes the position is outside of
+   */
+  static int outcode(const glm::vec4 &position, float extent) {
+    int code = 0;
+    for (int plane = 0; plane < CLIP_PLANES; plane++)
+      if (planeDistance(position, plane, extent) < 0) code |= 1 << plane;
+    return code;
+  }
+
+  /*!
+   * Clip a convex polygon against a single plane using Sutherland-Hodgman
+   * @param input Input polygon vertices in clip space
+   * @param count Number of input vertices
+   * @param plane Index of the plane to clip against
+   * @param output Output polygon vertices, has to fit CLIP_VERTICES
+   * @return Number of output vertices
+   */
+  static int clipPolygon(const ShadedVertex *input, int count, int plane, ShadedVertex *output) {
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+      auto &current = input[i];
+      auto &next = input[(i + 1) % count];
+      float d0 = planeDistance(current.position, plane, GUARD_BAND);
+      float d1 = planeDistance(next.position, plane, GUARD_BAND);
+      if (d0 >= 0)
+        output[result++] = current;
+      if ((d0 >= 0) != (d1 >= 0))
+        output[result++] = lerp(current, next, d0 / (d0 - d1));
+    }
+    return result;
+  }
+
+  /*!
+   * Prepare a triangle in clip space for rasterization
+   * @param v0 First vertex in clip space
+   * @param v1 Second vertex in clip space
+   * @param v2 Third vertex in clip space
+   * @return Triangle in viewport coordinates, the bounding box is empty if there is nothing to render
+   */
+  Triangle setup(const ShadedVertex &v0, const ShadedVertex &v1, const ShadedVertex &v2) {
+    Triangle triangle{toViewport(v0), toViewport(v1), toViewport(v2), {}, {}, {}, {}, 0, 0, 0, 0, 0, -1, -1};
+    auto &p0 = triangle.v0.position;
+    auto &p1 = triangle.v1.position;
+    auto &p2 = triangle.v2.position;
+    if (!std::isfinite(p0.x + p0.y + p1.x + p1.y + p2.x + p2.y))
+      return triangle;
+
+    // Snap the vertices to fixed point, the guard band keeps the coordinates small enough for 32 bit edge steps
+    const float scale = 1 << SUBPIXEL_BITS;
+    int x[3] = {(int) std::lround(p0.x * scale), (int) std::lround(p1.x * scale), (int) std::lround(p2.x * scale)};
+    int y[3] = {(int) std::lround(p0.y * scale), (int) std::lround(p1.y * scale), (int) std::lround(p2.y * scale)};
+
+    // Edge functions in fixed point, the sum of all three is twice the signed area of the triangle
+    int64_t a[3], b[3], c[3];
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      a[i] = (int64_t) y[j] - y[k];
+      b[i] = (int64_t) x[k] - x[j];
+      c[i] = (int64_t) x[j] * y[k] - (int64_t) x[k] * y[j];
+    }
+    int64_t area = c[0] + c[1] + c[2];
+    if (area == 0)
+      return triangle;
+
+    for (int i = 0; i < 3; i++) {
+      // Make the edge functions positive inside regardless of the winding
+      if (area < 0) {
+        a[i] = -a[i];
+        b[i] = -b[i];
+        c[i] = -c[i];
+      }
+      // Move the origin to the center of pixel 0, 0 and evaluate the function per pixel instead of per subpixel
+      // Its sign is preserved by rounding down, pixels exactly on an edge are only covered by top or left edges
+      bool topLeft = a[i] > 0 || (a[i] == 0 && b[i] > 0);
+      int64_t center = c[i] + (a[i] + b[i]) * (1 << (SUBPIXEL_BITS - 1));
+      int64_t pixel = floorDivide(center - (topLeft ? 0 : 1), 1 << SUBPIXEL_BITS);
+      triangle.edgeA[i] = (int) a[i];
+      triangle.edgeB[i] = (int) b[i];
+      triangle.edgeC[i] = pixel;
+      triangle.edgeOffset[i] = (float) (center - pixel * (1 << SUBPIXEL_BITS)) / scale;
+    }
+    triangle.invArea = (float) (scale / (double) std::abs(area));
+    triangle.nearest = std::min(std::min(p0.z, p1.z), p2.z);
+    triangle.farthest = std::max(std::max(p0.z, p1.z), p2.z);
+
+    // Bounding box of the pixel centers inside the bounds of the snapped vertices
+    const int pixel = 1 << SUBPIXEL_BITS, half = pixel / 2;
+    int minX = (int) floorDivide(std::min(std::min(x[0], x[1]), x[2]) - half + pixel - 1, pixel);
+    int minY = (int) floorDivide(std::min(std::min(y[0], y[1]), y[2]) - half + pixel - 1, pixel);
+    int maxX = (int) floorDivide(std::max(std::max(x[0], x[1]), x[2]) - half, pixel);
+    int maxY = (int) floorDivide(std::max(std::max(y[0], y[1]), y[2]) - half, pixel);
+    triangle.minX = std::max(minX, 0);
+    triangle.minY = std::max(minY, 0);
+    triangle.maxX = std::min(maxX, image.width - 1);
+    triangle.maxY = std::min(maxY, image.height - 1);
+    return triangle;
+  }
+
+  /*!
+   * Integer division rounding towards negative infinity
+   */
+  static int64_t floorDivide(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+  }
+
+  /*!
+   * Evaluate a fixed point edge function for a single pixel without any limit
+   * @param triangle Triangle the edge belongs to
+   * @param i Edge index
+   * @param x Horizontal position of the pixel
+   * @param y Vertical position of the pixel
+   * @return Edge function value of the pixel
+   */
+  static int64_t edgeValue(const Triangle &triangle, int i, int x, int y) {
+    return triangle.edgeA[i] * (int64_t) x + triangle.edgeB[i] * (int64_t) y + triangle.edgeC[i];
+  }
+
+  /*!
+   * Evaluate a fixed point edge function for a 2x2 quad of pixels
+   * The value is limited to EDGE_LIMIT so stepping over a block cannot overflow and keeps the sign of every pixel
+   * @param triangle Triangle the edge belongs to
+   * @param i Edge index
+   * @param x Horizontal position of the top left pixel
+   * @param y Vertical position of the top left pixel
+   * @param limited Set to true when the value had to be limited
+   * @return Edge function values of the quad pixels
+   */
+  static int4 edgeFunction(const Triangle &triangle, int i, int x, int y, bool &limited) {
+    int64_t value = edgeValue(triangle, i, x, y);
+    int start = (int) std::min(std::max(value, -EDGE_LIMIT), EDGE_LIMIT);
+    limited |= start != value;
+    return int4{start, start + triangle.edgeA[i], start + triangle.edgeB[i], start + triangle.edgeA[i] + triangle.edgeB[i]};
+  }
+
+  /*!
+   * Evaluate an edge function for a 2x2 quad of pixels in floating point without any limit, used for the barycentric
+   * coordinates of blocks where the fixed point values were limited and only their signs are right
+   * @param triangle Triangle the edge belongs to
+   * @param i Edge index
+   * @param x Horizontal position of the top left pixel
+   * @param y Vertical position of the top left pixel
+   * @return Edge function values of the quad pixels including the edge offset
+   */
+  static float4 edgeWeights(const Triangle &triangle, int i, int x, int y) {
+    int64_t value = edgeValue(triangle, i, x, y);
+    int64_t a = triangle.edgeA[i], b = triangle.edgeB[i];
+    return float4{(float) value, (float) (value + a), (float) (value + b), (float) (value + a + b)} + triangle.edgeOffset[i];
+  }
+
+  /*!
+   * Get a screen sized buffer plane as a span
+   * @param data First value of the plane
+   * @return Span of the whole plane
+   */
+  ppgso::ImageSpan<float> screenPlane(float *data) {
+    return {data, image.width, image.height, image.width * sizeof(float)};
+  }
+
+  /*!
+   * Copy a tile between the screen buffers and its private buffers
+   * @param tile Tile with private buffers
+   * @param store False to load the tile from the screen, true to store it back
+   */
+  void transferTile(const Tile &tile, bool store) {
+    transfer(image.span(), tile, tile.color, store);
+    transfer(screenPlane(depthBuffer.data()), tile, tile.depth, store);
+    for (int p = 0; p < SURFACES; p++)
+      transfer(screenPlane(&surfaceBuffer[p * image.width * image.height]), tile, tile.surfaces + p * tile.planeSize, store);
+  }
+
+  /*!
+   * Copy the region of a tile between a screen span and a private tile buffer
+   * @param screen Span of the whole screen
+   * @param tile Tile to copy, the private buffer uses the tile stride
+   * @param local Private buffer of the tile
+   * @param store False to copy from the screen to the private buffer, true to copy back
+   */
+  template<typename T>
+  static void transfer(const ppgso::ImageSpan<T> &screen, const Tile &tile, T *local, bool store) {
+    auto region = screen.crop(tile.x0, tile.y0, tile.x1 - tile.x0, tile.y1 - tile.y0);
+    for (int y = 0; y < region.height; y++) {
+      T *row = local + y * tile.stride;
+      if (store)
+        std::copy_n(row, region.width, region.row(y));
+      else
+        std::copy_n(region.row(y), region.width, row);
+    }
+  }
+
+  /*!
+   * Run the vertex shader once for every vertex of a mesh
+   * @param mesh Mesh to process, the results are stored in the shaded vertex buffer
+   */
+  void shade(const Mesh &mesh) {
+    shaded.positions.resize(mesh.vertices.size());
+    shaded.varyings.resize(mesh.vertices.size());
+    #pragma omp parallel for
+    for (int i = 0; i < (int) mesh.vertices.size(); i++)
+      shaded.positions[i] = program.vertexShader(mesh.vertices[i], shaded.varyings[i]);
+  }
+
+  /*!
+   * Cull and clip a face using the shaded vertices and prepare the result for rasterization
+   * @param face Face to process
+   * @param triangles Output vector the triangles to rasterize are appended to
+   */
+  void process(const Face &face, std::vector<Triangle> &triangles) {
+    auto &p0 = shaded.positions[face.v0];
+    auto &p1 = shaded.positions[face.v1];
+    auto &p2 = shaded.positions[face.v2];
+
+    // Back-face culling, the homogeneous determinant gives the winding as seen from the camera even for w < 0
+    float winding = glm::determinant(glm::mat3{p0.x, p0.y, p0.w, p1.x, p1.y, p1.w, p2.x, p2.y, p2.w});
+    if (!(winding > 0))
+      return;
+
+    // Reject triangles that are completely outside of the view frustum
+    if (outcode(p0, 1.0f) & outcode(p1, 1.0f) & outcode(p2, 1.0f))
+      return;
+
+    // Triangles inside of the guard band do not need clipping, the rasterizer only fills pixels on screen
+    int clipCode = outcode(p0, GUARD_BAND) | outcode(p1, GUARD_BAND) | outcode(p2, GUARD_BAND);
+    ShadedVertex polygon[CLIP_VERTICES] = {shaded.get(face.v0), shaded.get(face.v1), shaded.get(face.v2)};
+    if (!clipCode) {
+      triangles.push_back(setup(polygon[0], polygon[1], polygon[2]));
+      return;
+    }
+
+    // Clip against the planes the triangle crosses
+    ShadedVertex clipped[CLIP_VERTICES];
+    int count = 3;
+    for (int plane = 0; plane < CLIP_PLANES && count >= 3; plane++) {
+      if (!(clipCode & (1 << plane))) continue;
+      count = clipPolygon(polygon, count, plane, clipped);
+      std::copy_n(clipped, count, polygon);
+    }
+
+    // Split the resulting convex polygon into a triangle fan
+    for (int i = 1; i + 1 < count; i++)
+      triangles.push_back(setup(polygon[0], polygon[i], polygon[i + 1]));
+  }
+
+  /*!
+   * Rasterize a processed triangle into a render target
+   * @param tile Render target
+   * @param triangle Triangle to rasterize
+   */
+  void rasterize(const Tile &tile, const Triangle &triangle) {
+    // Range of pixels covered by both the triangle and the tile
+    int minX = std::max(triangle.minX, tile.x0);
+    int minY = std::max(triangle.minY, tile.y0);
+    int maxX = std::min(triangle.maxX, tile.x1 - 1);
+    int maxY = std::min(triangle.maxY, tile.y1 - 1);
+
+    // Steps of the edge functions between neighbouring quads
+    int4 stepX0 = 2 * triangle.edgeA[0], stepX1 = 2 * triangle.edgeA[1], stepX2 = 2 * triangle.edgeA[2];
+    int4 stepY0 = 2 * triangle.edgeB[0], stepY1 = 2 * triangle.edgeB[1], stepY2 = 2 * triangle.edgeB[2];
+
+    for (int by = (minY - tile.y0) / BLOCK_SIZE; by <= (maxY - tile.y0) / BLOCK_SIZE; by++) {
+      for (int bx = (minX - tile.x0) / BLOCK_SIZE; bx <= (maxX - tile.x0) / BLOCK_SIZE; bx++) {
+        // Skip blocks where the triangle is behind everything already rendered
+        auto &block = tile.blocks[bx + by * tile.blockStride];
+        if (triangle.nearest > block.farthest) continue;
+        if (block.stale) {
+          updateBlock(tile, bx, by);
+          if (triangle.nearest > block.farthest) continue;
+        }
+        // Triangles in front of the whole block do not need the per fragment depth test
+        bool depthTest = triangle.farthest > block.nearest;
+
+        // Quad aligned range of pixels covered by the triangle, the tile and the block
+        int blockX = tile.x0 + bx * BLOCK_SIZE;
+        int blockY = tile.y0 + by * BLOCK_SIZE;
+        int x0 = std::max(minX, blockX) & ~1;
+        int y0 = std::max(minY, blockY) & ~1;
+        int x1 = std::min(maxX, blockX + BLOCK_SIZE - 1);
+        int y1 = std::min(maxY, blockY + BLOCK_SIZE - 1);
+
+        // Edge functions of the first quad, the rest is reached by integer steps
+        bool limited = false;
+        int4 row0 = edgeFunction(triangle, 0, x0, y0, limited);
+        int4 row1 = edgeFunction(triangle, 1, x0, y0, limited);
+        int4 row2 = edgeFunction(triangle, 2, x0, y0, limited);
+        for (int y = y0; y <= y1; y += 2) {
+          int4 q0 = row0, q1 = row1, q2 = row2;
+          for (int x = x0; x <= x1; x += 2) {
+            // Fragments inside of all three edges and the tile
+            int mask = ~signMask(q0 | q1 | q2) & 0b1111;
+            if (x + 1 >= tile.x1) mask &= 0b0101;
+            if (y + 1 >= tile.y1) mask &= 0b0011;
+            if (mask && limited)
+              renderQuad(tile, triangle, x, y, edgeWeights(triangle, 0, x, y), edgeWeights(triangle, 1, x, y),
+                         edgeWeights(triangle, 2, x, y), mask, block, depthTest);
+            else if (mask)
+              renderQuad(tile, triangle, x, y, toFloat(q0) + triangle.edgeOffset.x, toFloat(q1) + triangle.edgeOffset.y,
+                         toFloat(q2) + triangle.edgeOffset.z, mask, block, depthTest);
+            q0 = q0 + stepX0;
+            q1 = q1 + stepX1;
+            q2 = q2 + stepX2;
+          }
+          row0 = row0 + stepY0;
+          row1 = row1 + stepY1;
+          row2 = row2 + stepY2;
+        }
+      }
+    }
+  }
+
+public:
+  /*!
+   * Initialize the rasterizer
+   * @param image Image to render to
+   * @param program Program to use for rendering
+   */
+  Rasterizer(ppgso::Image &image, Program &program) : program{program}, image{image} {
+    viewportMatrix = glm::translate(glm::scale(glm::mat4{1.0f}, glm::vec3{image.width / 2.0, -image.height / 2.0, 1.0}), glm::vec3{1, -1, 0});
+    clear();
+  };
+
+  /*!
+   * Clear depth buffer and image, the buffers are allocated once and reused when rendering a sequence of frames
+   */
+  void clear() {
+    // Clear the depth buffer, the G-buffer is only valid where something was rendered so it is just allocated
+    depthBuffer.assign((size_t) (image.width * image.height), std::numeric_limits<float>::max());
+    surfaceBuffer.resize((size_t) (SURFACES * image.width * image.height));
+    image.clear({128, 128, 128});
+  }
+
+  /*!
+   * Render a mesh into the image face by face, this is the serial path that renders directly to the whole image
+   * @param mesh Mesh to render
+   */
+  void renderSerial(const Mesh &mesh) {
+    shade(mesh);
+    int blocksX = (image.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int blocksY = (image.height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<DepthBlock> blocks((size_t) (blocksX * blocksY));
+    Tile screen{0, 0, image.width, image.height, image.width, depthBuffer.data(), image.getFramebuffer().data(),
+                surfaceBuffer.data(), image.width * image.height, blocksX, blocks.data()};
+    updateBlocks(screen);
+    std::vector<Triangle> triangles;
+    for (auto &face : mesh.faces) {
+      triangles.clear();
+      process(face, triangles);
+      for (auto &triangle : triangles)
+        rasterize(screen, triangle);
+    }
+  }
+
+  /*!
+   * Render a mesh into the image in parallel
+   * Vertices are shaded once, faces are processed in parallel batches, binned into screen tiles in submission order and
+   * the tiles are rasterized in parallel. The output is identical to renderSerial.
+   * @param mesh Mesh to render
+   */
+  void render(const Mesh &mesh) {
+    // Vertex processing
+    shade(mesh);
+
+    // Culling and clipping
+    auto &faces = mesh.faces;
+    batches.resize((faces.size() + BATCH_SIZE - 1) / BATCH_SIZE);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int) batches.size(); i++) {
+      batches[i].clear();
+      int end = std::min((i + 1) * BATCH_SIZE, (int) faces.size());
+      for (int j = i * BATCH_SIZE; j < end; j++)
+        process(faces[j], batches[i]);
+    }
+
+    // Binning, each bin keeps the triangles in submission order
+    int tilesX = (image.width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesY = (image.height + TILE_SIZE - 1) / TILE_SIZE;
+    bins.resize((size_t) (tilesX * tilesY));
+    for (auto &bin : bins)
+      bin.clear();
+    for (auto &batch : batches) {
+      for (auto &triangle : batch) {
+        for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE && triangle.minY <= triangle.maxY; ty++)
+          for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE && triangle.minX <= triangle.maxX; tx++)
+            bins[tx + ty * tilesX].push_back(&triangle);
+      }
+    }
+
+    // Rasterization, each thread renders whole tiles into private buffers
+    #pragma omp parallel
+    {
+      std::vector<float> depth(TILE_SIZE * TILE_SIZE);
+      std::vector<ppgso::Image::Pixel> color(TILE_SIZE * TILE_SIZE);
+      std::vector<float> surfaces(SURFACES * TILE_SIZE * TILE_SIZE);
+      std::vector<DepthBlock> blocks((TILE_SIZE / BLOCK_SIZE) * (TILE_SIZE / BLOCK_SIZE));
+
+      #pragma omp for schedule(dynamic)
+      for (int i = 0; i < (int) bins.size(); i++) {
+        if (bins[i].empty()) continue;
+
+        Tile tile{(i % tilesX) * TILE_SIZE, (i / tilesX) * TILE_SIZE, 0, 0, TILE_SIZE, depth.data(), color.data(),
+                  surfaces.data(), TILE_SIZE * TILE_SIZE, TILE_SIZE / BLOCK_SIZE, blocks.data()};
+        tile.x1 = std::min(tile.x0 + TILE_SIZE, image.width);
+        tile.y1 = std::min(tile.y0 + TILE_SIZE, image.height);
+
+        // Load the tile, render it and store it back
+        transferTile(tile, false);
+        updateBlocks(tile);
+        for (auto triangle : bins[i])
+          rasterize(tile, *triangle);
+        transferTile(tile, true);
+      }
+    }
+  }
+  /*!
+   * Lighting pass of deferred shading, shades every pixel covered by the G-buffer exactly once
+   * Tiles are shaded in parallel, world positions are reconstructed from the depth buffer and only the lights that reach
+   * the world space bounds of the visible pixels of a tile are passed to the lighting shader
+   */
+  void lightingPass() {
+    using Surface = typename Program::template Surface<float4>;
+    static_assert(SURFACES > 0, "Lighting pass requires a program that renders to the G-buffer");
+
+    // Inverse of the view and projection transformations, pixel centers are mapped to <-1,1> first
+    glm::mat4 inverse = glm::inverse(program.projectionMatrix * program.viewMatrix);
+    float4 scaleX = 2.0f / image.width, scaleY = -2.0f / image.height;
+
+    /*!
+     * Visible pixels of a 2x2 quad and their world positions
+     */
+    struct Quad {
+      int offsets[4];
+      int mask;
+      float4 x, y, z;
+    };
+
+    auto tiles = image.span().tiles(TILE_SIZE, TILE_SIZE);
+    int planeSize = image.width * image.height;
+    Tile screen{0, 0, image.width, image.height, image.width, depthBuffer.data(), image.getFramebuffer().data(),
+                surfaceBuffer.data(), planeSize, 0, nullptr};
+    #pragma omp parallel
+    {
+      std::vector<Quad> quads;
+      std::vector<const PointLight*> lights;
+
+      #pragma omp for schedule(dynamic)
+      for (int i = 0; i < (int) tiles.size(); i++) {
+        int x0 = tiles[i].left, x1 = x0 + tiles[i].width;
+        int y0 = tiles[i].top, y1 = y0 + tiles[i].height;
+
+        // Reconstruct world positions of the visible pixels and bound them
+        quads.clear();
+        glm::vec3 low{std::numeric_limits<float>::max()}, high{std::numeric_limits<float>::lowest()};
+        for (int y = y0; y < y1; y += 2) {
+          for (int x = x0; x < x1; x += 2) {
+            int offset = x + y * image.width;
+            Quad quad{{offset, offset + 1, offset + image.width, offset + image.width + 1}, 0b1111, 0.0f, 0.0f, 0.0f};
+            if (x + 1 >= x1) quad.mask &= 0b0101;
+            if (y + 1 >= y1) quad.mask &= 0b0011;
+            float depth[4];
+            for (int j = 0; j < 4; j++) {
+              depth[j] = quad.mask & (1 << j) ? depthBuffer[quad.offsets[j]] : std::numeric_limits<float>::max();
+              if (depth[j] == std::numeric_limits<float>::max()) quad.mask &= ~(1 << j);
+            }
+            if (!quad.mask) continue;
+
+            float4 nx = float4{x + .5f, x + 1.5f, x + .5f, x + 1.5f} * scaleX - 1.0f;
+            float4 ny = float4{y + .5f, y + .5f, y + 1.5f, y + 1.5f} * scaleY + 1.0f;
+            float4 nz{depth[0], depth[1], depth[2], depth[3]};
+            float4 w = nx * inverse[0][3] + ny * inverse[1][3] + nz * inverse[2][3] + inverse[3][3];
+            quad.x = (nx * inverse[0][0] + ny * inverse[1][0] + nz * inverse[2][0] + inverse[3][0]) / w;
+            quad.y = (nx * inverse[0][1] + ny * inverse[1][1] + nz * inverse[2][1] + inverse[3][1]) / w;
+            quad.z = (nx * inverse[0][2] + ny * inverse[1][2] + nz * inverse[2][2] + inverse[3][2]) / w;
+            for (int j = 0; j < 4; j++) {
+              if (!(quad.mask & (1 << j))) continue;
+              glm::vec3 position{quad.x[j], quad.y[j], quad.z[j]};
+              low = glm::min(low, position);
+              high = glm::max(high, position);
+            }
+            quads.push_back(quad);
+          }
+        }
+        if (quads.empty()) continue;
+
+        // Cull lights whose sphere of influence misses the bounds
+        lights.clear();
+        for (auto &light : program.lights) {
+          glm::vec3 distance = glm::clamp(light.position, low, high) - light.position;
+          if (glm::dot(distance, distance) <= light.radius * light.radius)
+            lights.push_back(&light);
+        }
+
+        // Shade each visible pixel once
+        for (auto &quad : quads) {
+          Surface surface;
+          auto output = reinterpret_cast<float4*>(&surface);
+          for (int p = 0; p < SURFACES; p++) {
+            const float *plane = &surfaceBuffer[p * planeSize];
+            float values[4];
+            for (int j = 0; j < 4; j++)
+              values[j] = quad.mask & (1 << j) ? plane[quad.offsets[j]] : 0.0f;
+            output[p] = float4{values[0], values[1], values[2], values[3]};
+          }
+          write(screen, quad.offsets, quad.mask, program.lightingShader(surface, quad.x, quad.y, quad.z, lights));
+        }
+      }
+    }
+  }
+};
@@ -1,56 +1,57 @@
 // Example raw4_raster
 // - This example implements a very simple software rasterizer that mimics parts of the OpenGL pipeline with vertex and fragment shaders
-// - Some of the pipeline steps such as culling, clipping were skipped for simplicity and readability
-// - Triangle rendering is realized using horizontal triangle splitting and filling is implemented using linear interpolation
+// - The rasterizer is a template specialized for the shader program, only the varying data declared by the program is
+//   interpolated and the shaders are inlined into the rasterization loops
+// - Back facing triangles are culled and the rest is clipped in homogeneous clip space using Sutherland-Hodgman
+//   against the near and far planes, the screen sides are only clipped to a guard band around the viewport
+// - Triangles are rasterized using edge functions in 2x2 quads of fragments, each quad is interpolated, depth tested
+//   and shaded four fragments at a time using SIMD instructions
+// - Vertices are snapped to 1/256 of a pixel and the edge functions are stepped in integers with a top-left fill rule,
+//   so pixels on edges shared by two triangles are shaded exactly once
+// - Textures are sampled with trilinear filtering from a mip chain, the level of detail comes from the 2x2 quads
+// - A coarse depth buffer keeps the nearest and farthest depth of each 8x8 block of pixels, triangles behind a block are
+//   rejected before any quad of the block is rasterized
+// - Meshes are rendered using a sort-middle approach: vertices are processed in parallel, triangles are binned into
+//   screen tiles and the tiles are rasterized in parallel, each into its own private depth and color buffer
+// - Run with --deferred to use deferred shading: the geometry pass stores normal, albedo and texture coordinates to
+//   G-buffer planes and a tile based lighting pass shades each visible pixel once using only the lights that reach the tile
+// - Run with --frames N to render a turntable of N frames, finished frames are saved by a background thread while the
+//   next frame is rendered and all buffers are reused between frames, frames are stored as lossless QOI images
 
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include <ppgso/ppgso.h>
 #include <glm/gtx/euler_angles.hpp>
 
-/*!
- * Vertex structure to hold per vertex data in
- */
-struct Vertex {
-  glm::vec4 position;
-  glm::vec4 normal;
-  glm::vec2 texCoord;
-  glm::vec4 color;
-};
-
-/*!
- * Vertex interpolation function that interpolates position, normal, texCoord and color vectors between two vertices
- * @param v0 First vertex
- * @param v1 Second vertex
- * @param t Interpolation amount, range <0,1>
- * @return Linear combination of v0 and v1
- */
-Vertex lerp(const Vertex &v0, const Vertex &v1, float t) {
-  auto z = glm::lerp(1.0f / v0.position.z, 1.0f / v1.position.z, t);
-  auto texCoord = glm::lerp(v0.texCoord / v0.position.z, v1.texCoord / v1.position.z, t) / z;
-  return Vertex{
-      glm::lerp(v0.position, v1.position, t),
-      glm::lerp(v0.normal, v1.normal, t),
-      texCoord,
-      glm::lerp(v0.color, v1.color, t)
-  };
-}
-
-/*!
- * Face structure to hold three vertices that form a triangle/face
- */
-struct Face {
-  Vertex v0, v1, v2;
-};
+#include "float4.h"
+#include "rasterizer.h"
+#include "texture_map.h"
 
 class Program {
 public:
+  /*!
+   * Varying data passed from the vertex shader to the fragment shader
+   * The rasterizer uses T = float for vertices and T = float4 for 2x2 quads of fragments
+   */
+  template<typename T>
+  struct Varying {
+    T u, v;
+    T r, g, b;
+  };
+
   /*!
    * Program constructor that expects texture reference
    */
-  Program(ppgso::Image &texture) : texture{texture} {};
+  Program(TextureMap &texture) : texture{texture} {};
 
   // Uniform inputs common for all vertices
-  ppgso::Image &texture;
+  TextureMap &texture;
   glm::mat4 modelMatrix;
   glm::mat4 viewMatrix;
   glm::mat4 projectionMatrix;
@@ -58,254 +59,267 @@ public:
   /*!
    * Vertex shader is a program that can manipulate vertex data, typically changing the vertex position using a perspective projection matrix.
    * @param vertex Vertex to manipulate.
-   * @return Output vertex, position on screen is expected to be in the <-1,1> range for x and y coordinates.
+   * @param varying Output varying data for the fragment shader.
+   * @return Output position, position on screen is expected to be in the <-1,1> range for x and y coordinates.
    */
-  Vertex vertexShader(const Vertex &vertex) {
+  glm::vec4 vertexShader(const Vertex &vertex, Varying<float> &varying) {
     // Transform the vertex position to world coordinates
     glm::vec4 worldCoordinates = modelMatrix * vertex.position;
     // Transform the position to camera coordinates
     glm::vec4 cameraCoordinates = viewMatrix * worldCoordinates;
     // Project the camera coordinates to screen coordinates
     glm::vec4 screenCoordinates = projectionMatrix * cameraCoordinates;
-    // Multiply normal with modelMatrix so that normals are always in world coordinates.
     // Pass on color and texture coordinates unchanged.
-    return Vertex{screenCoordinates, modelMatrix * vertex.normal, vertex.texCoord, vertex.color};
+    varying = Varying<float>{vertex.texCoord.x, vertex.texCoord.y, vertex.color.r, vertex.color.g, vertex.color.b};
+    return screenCoordinates;
   };
 
   /*!
    * Fragment shader is a program that is responsible for generating the final output color for each fragment, in this case we have 1 fragment per pixel.
+   * Fragments are shaded in 2x2 quads, every operation works on all four fragments at once.
    * @param varying Varying vertex data that is interpolated from the triangle vertices
-   * @return Fragment color
+   * @return Fragment colors
    */
-  glm::vec4 fragmentShader(const Vertex &varying) {
-    // Simple directional light
-    float lighting = 1; //std::max(0.0f, (float) dot(varying.normal, vec4{.5f, .5f, .5f, 0.0f}));
+  QuadColor fragmentShader(const Varying<float4> &varying) {
+    // Simple directional light, pass the normal multiplied with modelMatrix as varying data to compute it
+    float4 lighting = 1;
+    // NOTE: The coordinates are vertically inverted for compatibility with object files generated using Blender 3D.
+    Texels texel = texture.sample(varying.u, 1.0f - varying.v);
     // Compute output color
-    return varying.color * lighting * sample(texture, varying.texCoord);
+    return QuadColor{
+        varying.r * lighting * texel.r,
+        varying.g * lighting * texel.g,
+        varying.b * lighting * texel.b
+    };
   };
-private:
-  /*!
-   * Get a color sample from image for given normalized texture coordinates
-   * @param image Image to obtain raw color information from.
-   * @param textCoord Normalized 2D coordinates to get color sample from.
-   * @return
-   */
-  glm::vec4 sample(ppgso::Image &image, glm::vec2 textCoord) {
-    // Get the appropriate pixel for given texture coordinates.
-    textCoord = clamp(textCoord, 0.0f, 1.0f);
-    auto x = (int) (textCoord.x * (image.width - 1));
-    auto y = (int) (textCoord.y * (image.height - 1));
-    // NOTE: The coordinates are vertically inverted for compatibility with object files generated using Blender 3D.
-    auto pixel = image.getPixel(x, image.height-y);
-    // Return normalized color vector
-    return glm::vec4{pixel.r / 255.0f, pixel.g / 255.0f, pixel.b / 255.0f, 1.0};
-  }
 };
 
 /*!
- * Simple rasterizer class that can render triangles into an image
+ * Shader program for deferred shading with point lights
  */
-class Rasterizer {
-private:
-  Program &program;
-  ppgso::Image &image;
-  std::vector<float> depthBuffer;
-
+class DeferredProgram {
+public:
   /*!
-   * Transform a vertex from screen coordinates to viewport/image coordinates
-   * @param vertex Vertex to transform to viewport. The visible range is <-1,1> for x and y coordinates
-   * @return Vertex that has position transformed to viewport/image coordinates
+   * Varying data passed from the vertex shader to the fragment shader
    */
-  Vertex toViewport(const Vertex &vertex) {
-    // Matrix that aligns the screen coordinates to viewport coordinates
-    static const glm::mat4 viewportMatrix = glm::translate(glm::scale(glm::mat4{1.0f}, glm::vec3{image.width / 2.0, -image.height / 2.0, 1.0}), glm::vec3{1, -1, 0});
-    // First convert homogeneous coordinates to cartesian and transform to viewport
-    glm::vec4 viewportCoordinates = viewportMatrix * (vertex.position / vertex.position.w);
-    // Copy rest of the data without change
-    return Vertex{viewportCoordinates, vertex.normal, vertex.texCoord, vertex.color};
-  }
+  template<typename T>
+  struct Varying {
+    T u, v;
+    T r, g, b;
+    T nx, ny, nz;
+  };
 
   /*!
-   * Set the pixel in the output using the varying data stored in Vertex
-   * @param x Fragment horizontal position
-   * @param y Fragment vertical position
-   * @param varying Varying vertex data to pass to fragment shader which will generate the pixel color
+   * Surface data stored in the G-buffer by the fragment shader, world space normal, albedo and texture coordinates
    */
-  void setFragment(const Vertex &varying) {
-    int x = (int) varying.position.x;
-    int y = (int) varying.position.y;
-    // Do not render pixels outside of the image
-    if (x < 0 || y < 0 || x >= image.width || y >= image.height)
-      return;
-
-    // Check and update the depth buffer
-    if (depthBuffer[x + y * image.width] < varying.position.z)
-      return;
-
-    depthBuffer[x + y * image.height] = varying.position.z;
-
-    // Compute the fragment color and limit the output
-    glm::vec4 color = clamp(program.fragmentShader(varying), 0.0f, 1.0f);
-    image.setPixel(x, y, color.r, color.g, color.b);
-  }
+  template<typename T>
+  struct Surface {
+    T nx, ny, nz;
+    T r, g, b;
+    T u, v;
+  };
 
   /*!
-   * Fill the top portion of a triangle that has split horizontally by using interpolation between vertices
-   * @param v0 - Top vertex of the triangle
-   * @param v1 - First bottom vertex
-   * @param v2 - Second bottom vertex
+   * Program constructor that expects texture reference
    */
-  void renderTopTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2) {
-    for (int y = 0; v0.position.y + y <= v2.position.y; ++y) {
-      float yt = v0.position.y >= v2.position.y ? 0 : y / (v2.position.y - v0.position.y);
-      Vertex a = lerp(v0, v1, yt);
-      Vertex b = lerp(v0, v2, yt);
-      if (a.position.x > b.position.x) std::swap(a, b);
-      for (int x = 0; a.position.x + x <= b.position.x; ++x) {
-        float xt = a.position.x >= b.position.x ? 0 : x / (b.position.x - a.position.x);
-        Vertex varying = lerp(a, b, xt);
-        setFragment(varying);
-      }
-    }
-  }
+  DeferredProgram(TextureMap &texture) : texture{texture} {};
 
-  /*!
-   * Fill the bottom portion of a triangle that has split horizontally by using interpolation between vertices
-   * @param v0 - First top vertex of the triangle
-   * @param v1 - Second top vertex
-   * @param v2 - Bottom vertex
-   */
-  void renderBottomTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2) {
-    for (int y = 0; v0.position.y + y <= v2.position.y; ++y) {
-      float yt =  v0.position.y >= v2.position.y ? 0 : y / (v2.position.y - v0.position.y);
-      Vertex a = lerp(v0, v2, yt);
-      Vertex b = lerp(v1, v2, yt);
-      if (a.position.x > b.position.x) std::swap(a, b);
-      for (int x = 0; a.position.x + x <= b.position.x; ++x) {
-        float xt = a.position.x >= b.position.x ? 0 : x / (b.position.x - a.position.x);
-        Vertex varying = lerp(a, b, xt);
-        setFragment(varying);
-      }
-    }
-  }
+  // Uniform inputs common for all vertices and fragments
+  TextureMap &texture;
+  glm::mat4 modelMatrix;
+  glm::mat4 viewMatrix;
+  glm::mat4 projectionMatrix;
+  glm::vec3 ambient;
+  std::vector<PointLight> lights;
 
-public:
   /*!
-   * Initialize the rasterizer
-   * @param image Image to render to
-   * @param program Program to use for rendering
+   * Vertex shader transforms the position to clip space and the normal to world space
+   * @param vertex Vertex to manipulate.
+   * @param varying Output varying data for the fragment shader.
+   * @return Output position in clip space.
    */
-  Rasterizer(ppgso::Image &image, Program &program) : program{program}, image{image} {
-    clear();
+  glm::vec4 vertexShader(const Vertex &vertex, Varying<float> &varying) {
+    glm::vec3 normal = glm::mat3{modelMatrix} * glm::vec3{vertex.normal};
+    varying = Varying<float>{vertex.texCoord.x, vertex.texCoord.y, vertex.color.r, vertex.color.g, vertex.color.b, normal.x, normal.y, normal.z};
+    return projectionMatrix * viewMatrix * modelMatrix * vertex.position;
   };
 
   /*!
-   * Clear depth buffer and image
+   * Fragment shader of the geometry pass, computes the surface data of a 2x2 quad of fragments
+   * @param varying Varying vertex data that is interpolated from the triangle vertices
+   * @return Surface data to store in the G-buffer
    */
-  void clear() {
-    // Clear the depth buffer
-    depthBuffer = std::vector<float>((unsigned long) (image.width * image.height), std::numeric_limits<float>::max());
-    // Clear the image
-    image.clear({128,128,128});
-  }
+  Surface<float4> fragmentShader(const Varying<float4> &varying) {
+    // NOTE: The coordinates are vertically inverted for compatibility with object files generated using Blender 3D.
+    Texels texel = texture.sample(varying.u, 1.0f - varying.v);
+    float4 length = sqrt(varying.nx * varying.nx + varying.ny * varying.ny + varying.nz * varying.nz);
+    return Surface<float4>{
+        varying.nx / length, varying.ny / length, varying.nz / length,
+        varying.r * texel.r, varying.g * texel.g, varying.b * texel.b,
+        varying.u, varying.v
+    };
+  };
 
   /*!
-   * Render a face into the image
-   * @param face Face to render
+   * Lighting shader computes the final color of a 2x2 quad of pixels from the G-buffer
+   * Light falls off smoothly to zero at its radius so lights culled by the rasterizer would not contribute anyway
+   * @param surface Surface data from the G-buffer
+   * @param x World space position
+   * @param y World space position
+   * @param z World space position
+   * @param lights Lights that can reach the pixels
+   * @return Pixel colors
    */
-  void render(const Face &face) {
-    // transform vertices
-    Vertex t0 = toViewport(program.vertexShader(face.v0));
-    Vertex t1 = toViewport(program.vertexShader(face.v1));
-    Vertex t2 = toViewport(program.vertexShader(face.v2));
-    // Sort the vertices
-    if (t0.position.y > t1.position.y) std::swap(t0, t1);
-    if (t0.position.y > t2.position.y) std::swap(t0, t2);
-    if (t1.position.y > t2.position.y) std::swap(t1, t2);
-    // Split the triangle into top/bottom sections
-    float t = t0.position.y >= t2.position.y ? 0 : (t1.position.y - t0.position.y) / (t2.position.y - t0.position.y);
-    Vertex tm = lerp(t0, t2, t);
-
-    // Render
-    renderTopTriangle(t0, tm, t1);
-    renderBottomTriangle(t1, tm, t2);
-  }
+  QuadColor lightingShader(const Surface<float4> &surface, const float4 &x, const float4 &y, const float4 &z, const std::vector<const PointLight*> &lights) {
+    float4 r = ambient.r, g = ambient.g, b = ambient.b;
+    for (auto light : lights) {
+      float4 dx = light->position.x - x, dy = light->position.y - y, dz = light->position.z - z;
+      float4 distance = sqrt(dx * dx + dy * dy + dz * dz);
+      float4 diffuse = max((surface.nx * dx + surface.ny * dy + surface.nz * dz) / distance, 0.0f);
+      float4 falloff = max(1.0f - distance * (1.0f / light->radius), 0.0f);
+      float4 intensity = diffuse * falloff * falloff;
+      r = r + intensity * light->color.r;
+      g = g + intensity * light->color.g;
+      b = b + intensity * light->color.b;
+    }
+    return QuadColor{surface.r * r, surface.g * g, surface.b * b};
+  };
 };
 
 /*!
- * Load Wavefront obj file data as vector of faces for simplicity
- * @return vector of Faces that can be rendered
+ * Set the camera and model transformations used by both programs
+ * @param program Program to set the uniforms of
+ * @param image Image the program renders to
+ * @param angle Rotation of the model around the vertical axis
  */
-std::vector<Face> loadObjFile(const std::string filename) {
+template<typename P>
+void setTransformations(P &program, const ppgso::Image &image, float angle = 0) {
+  program.modelMatrix = glm::rotate(glm::mat4{1.0f}, angle, glm::vec3{0, 1, 0}) * orientate4(glm::vec3{0,0.4,.8});
+  program.viewMatrix = lookAt(glm::vec3{0,.7,.7}, glm::vec3{0,0,0}, glm::vec3{.5, .5, 0});
+  program.projectionMatrix = glm::perspective((ppgso::PI / 180.f) * 60.0f, (float)image.width / (float)image.height, 0.1f, 15.0f);
+}
+
+/*!
+ * Load Wavefront obj file data as an indexed mesh
+ * @return Mesh that can be rendered
+ */
+Mesh loadObjFile(const std::string filename) {
   // Using tiny obj loader from ppgso lib
   std::vector<tinyobj::shape_t> shapes;
   std::vector<tinyobj::material_t> materials;
   std::string err = tinyobj::LoadObj(shapes, materials, filename.c_str());
 
-  // Will only convert 1st shape to Faces
-  auto &mesh = shapes[0].mesh;
+  // Will only convert 1st shape to Mesh
+  auto &shape = shapes[0].mesh;
 
-  // Collect data in vectors
-  std::vector<glm::vec4> positions;
-  for (int i = 0; i < (int) mesh.positions.size() / 3; ++i)
-    positions.emplace_back(mesh.positions[3 * i], mesh.positions[3 * i + 1], mesh.positions[3 * i + 2], 1);
+  // Positions, normals and texture coordinates share the same indices
+  Mesh mesh;
+  mesh.vertices.resize(shape.positions.size() / 3);
+  for (int i = 0; i < (int) mesh.vertices.size(); ++i) {
+    auto &vertex = mesh.vertices[i];
+    vertex = Vertex{{shape.positions[3 * i], shape.positions[3 * i + 1], shape.positions[3 * i + 2], 1}, {0, 0, 0, 0}, {0, 0}, {1, 1, 1, 1}};
+    if (shape.normals.size() >= 3 * (size_t) (i + 1))
+      vertex.normal = {shape.normals[3 * i], shape.normals[3 * i + 1], shape.normals[3 * i + 2], 1};
+    if (shape.texcoords.size() >= 2 * (size_t) (i + 1))
+      vertex.texCoord = {shape.texcoords[2 * i], shape.texcoords[2 * i + 1]};
+  }
 
-  std::vector<glm::vec4> normals;
-  for (int i = 0; i < (int) mesh.normals.size() / 3; ++i)
-    normals.emplace_back(mesh.normals[3 * i], mesh.normals[3 * i + 1], mesh.normals[3 * i + 2], 1);
+  // Fill the vector of Faces with indices
+  mesh.faces.resize(shape.indices.size() / 3);
+  for (int i = 0; i < (int) mesh.faces.size(); i++)
+    mesh.faces[i] = Face{shape.indices[i * 3], shape.indices[i * 3 + 1], shape.indices[i * 3 + 2]};
+  return mesh;
+};
 
-  std::vector<glm::vec2> texcoords;
-  for (int i = 0; i < (int) mesh.texcoords.size() / 2; ++i)
-    texcoords.emplace_back(mesh.texcoords[2 * i], mesh.texcoords[2 * i + 1]);
+/*!
+ * Render a frame using the forward shading program
+ */
+void renderFrame(Rasterizer<Program> &rasterizer, const Mesh &mesh) {
+  rasterizer.render(mesh);
+}
 
-  // Fill the vector of Faces with data
-  std::vector<Face> faces(mesh.indices.size() / 3);
-  for (int i = 0; i < (int) faces.size(); i++) {
-    faces[i] = Face{
-        {
-            positions[mesh.indices[i * 3]],
-            normals[mesh.indices[i * 3]],
-            texcoords[mesh.indices[i * 3]],
-            {1, 1, 1, 1}
-        }, {
-            positions[mesh.indices[i * 3 + 1]],
-            normals[mesh.indices[i * 3 + 1]],
-            texcoords[mesh.indices[i * 3 + 1]],
-            {1, 1, 1, 1}
-        }, {
-            positions[mesh.indices[i * 3 + 2]],
-            normals[mesh.indices[i * 3 + 2]],
-            texcoords[mesh.indices[i * 3 + 2]],
-            {1, 1, 1, 1}
-        }
-    };
+/*!
+ * Render a frame using the deferred shading program, the G-buffer is filled first and then lit
+ */
+void renderFrame(Rasterizer<DeferredProgram> &rasterizer, const Mesh &mesh) {
+  rasterizer.render(mesh);
+  rasterizer.lightingPass();
+}
+
+/*!
+ * Render a still image or a turntable sequence of frames and save it
+ * Frames of a sequence are saved by a background thread while the next frame is rendered, the rasterizer buffers and
+ * the framebuffers recycled by the writer are reused for all frames
+ * @param program Program to render with
+ * @param mesh Mesh to render
+ * @param image Image to render to
+ * @param frames Number of frames of the sequence, 0 renders a single still image
+ * @param name Output file name without extension, frames are numbered QOI images
+ */
+template<typename P>
+void renderImages(P &program, const Mesh &mesh, ppgso::Image &image, int frames, const std::string &name) {
+  Rasterizer<P> rasterizer{image, program};
+  if (frames == 0) {
+    setTransformations(program, image);
+    renderFrame(rasterizer, mesh);
+    ppgso::image::saveBMP(image, name + ".bmp");
+    return;
   }
-  return faces;
-};
 
-int main() {
-  // Image to store the rendering to
-  ppgso::Image image{512, 512};
-  // Vector of faces loaded from Wavefront obj file
-  auto faces = loadObjFile("corsair.obj");
-  // Image to use as texture in the shader program
-  ppgso::Image texture{ppgso::image::loadBMP("corsair.bmp")};
-  // Shader program to use
-  Program program{texture};
-  // Set program uniforms
-  program.modelMatrix = orientate4(glm::vec3{0,0.4,.8});
-  program.viewMatrix = lookAt(glm::vec3{0,.7,.7}, glm::vec3{0,0,0}, glm::vec3{.5, .5, 0});
-  program.projectionMatrix = glm::perspective((ppgso::PI / 180.f) * 60.0f, (float)image.width / (float)image.height, 1.0f, 15.0f);
+  auto start = std::chrono::steady_clock::now();
+  {
+    ppgso::ImageWriter writer;
+    for (int frame = 0; frame < frames; frame++) {
+      setTransformations(program, image, 2.0f * ppgso::PI * frame / frames);
+      renderFrame(rasterizer, mesh);
+      std::stringstream filename;
+      filename << name << "_" << std::setw(4) << std::setfill('0') << frame << ".qoi";
+      writer.submit(image, filename.str());
+      rasterizer.clear();
+    }
+  }
+  std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+  std::cout << frames << " frames in " << seconds.count() << " s, " << frames / seconds.count() << " fps" << std::endl;
+}
 
-  // Rasterizer instance
-  Rasterizer rasterizer{image, program};
+int main(int argc, char *argv[]) {
+  // Options: --deferred for deferred shading, --frames N to render a turntable sequence of N frames
+  bool deferred = false;
+  int frames = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string option{argv[i]};
+    if (option == "--deferred") {
+      deferred = true;
+    } else if (option == "--frames" && i + 1 < argc) {
+      frames = std::max(std::atoi(argv[++i]), 0);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--deferred] [--frames N]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
-  // Render all faces
-  for (auto &face : faces)
-    rasterizer.render(face);
+  // Image to store the rendering to
+  ppgso::Image image{512, 512};
+  // Indexed mesh loaded from Wavefront obj file
+  auto mesh = loadObjFile("corsair.obj");
+  // Mipmapped texture to use in the shader program
+  TextureMap texture{ppgso::image::loadBMP("corsair.bmp")};
 
-  // Save the image
-  ppgso::image::saveBMP(image, "raw4_raster.bmp");
+  if (deferred) {
+    // Shader program with a ring of colored point lights around the model
+    DeferredProgram program{texture};
+    program.ambient = {.2, .2, .2};
+    for (int i = 0; i < 16; i++) {
+      float angle = 2.0f * ppgso::PI * i / 16.0f;
+      glm::vec3 color{.6f + .4f * std::cos(angle), .6f + .4f * std::cos(angle + 2.1f), .6f + .4f * std::cos(angle + 4.2f)};
+      program.lights.push_back({{.45f * std::cos(angle), .35f + .32f * std::sin(angle), .35f - .32f * std::sin(angle)}, color, .8f});
+    }
+    renderImages(program, mesh, image, frames, "raw4_raster_deferred");
+  } else {
+    // Shader program to use
+    Program program{texture};
+    renderImages(program, mesh, image, frames, "raw4_raster");
+  }
 
   std::cout << "Done." << std::endl;
   return EXIT_SUCCESS;
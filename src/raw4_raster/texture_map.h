@@ -0,0 +1,158 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <ppgso/ppgso.h>
+
+#include "float4.h"
+
+/*!
+ * Texture samples of a 2x2 quad of fragments, one float4 lane per fragment, channels are in range <0, 1>
+ */
+struct Texels {
+  float4 r, g, b, a;
+};
+
+/*!
+ * Texture for the software rasterizer with a precomputed mip chain and bilinear/trilinear filtering
+ * Texels are stored as RGBA8 in tiles of 4x4 texels, one 64 byte cache line per tile, and the texels of a tile are in
+ * Morton order so the 2x2 footprint of a bilinear fetch mostly stays inside one cache line
+ */
+class TextureMap {
+public:
+  /*!
+   * Create texture from an image and generate all mip levels
+   * @param image Image to use, the first row is at texture coordinate v = 0
+   */
+  TextureMap(ppgso::Image &&image) {
+    levels.push_back(createLevel(image));
+
+    // Each level averages 2x2 texels of the previous one, odd sizes drop the last row or column
+    for (auto &mipmap : ppgso::image::generateMipmaps(image.view()))
+      levels.push_back(createLevel(mipmap));
+  }
+
+  /*!
+   * Sample the texture for a 2x2 quad of fragments using trilinear filtering
+   * The level of detail is computed once per quad from the differences of neighbouring lanes
+   * Coordinates are clamped to the <0, 1> range after the level of detail is computed from them
+   * @param u Horizontal texture coordinates, lanes ordered as in Quad
+   * @param v Vertical texture coordinates, lanes ordered as in Quad
+   * @return Filtered texture samples
+   */
+  Texels sample(const float4 &u, const float4 &v) const {
+    // Screen space derivatives in texels of the base level, clamped coordinates would not change across the edges
+    float us[4], vs[4];
+    u.store(us);
+    v.store(vs);
+    auto &base = levels.front();
+    float dudx = (us[1] - us[0]) * base.width, dvdx = (vs[1] - vs[0]) * base.height;
+    float dudy = (us[2] - us[0]) * base.width, dvdy = (vs[2] - vs[0]) * base.height;
+    float rho = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    float lod = rho > 1.0f ? std::min(0.5f * std::log2(rho), (float) levels.size() - 1) : 0.0f;
+
+    // Blend bilinear samples from the two nearest levels
+    int level = (int) lod;
+    int next = std::min(level + 1, (int) levels.size() - 1);
+    float4 t = lod - (float) level;
+    clamp(u, 0.0f, 1.0f).store(us);
+    clamp(v, 0.0f, 1.0f).store(vs);
+    float4 r, g, b, a;
+    float4 *texels[4] = {&r, &g, &b, &a};
+    for (int i = 0; i < 4; i++)
+      *texels[i] = lerp(bilinear(levels[level], us[i], vs[i]), bilinear(levels[next], us[i], vs[i]), t);
+
+    // Convert from one texel per lane to one channel per lane
+    transpose(r, g, b, a);
+    const float4 scale = 1.0f / 255.0f;
+    return Texels{r * scale, g * scale, b * scale, a * scale};
+  }
+
+  /*!
+   * Get number of mip levels
+   * @return Number of levels including the base level
+   */
+  int getLevels() const {
+    return (int) levels.size();
+  }
+
+private:
+  /*!
+   * Single mip level, tilesX is the number of 4x4 tiles in a row
+   */
+  struct Level {
+    int width, height, tilesX;
+    std::vector<uint32_t> texels;
+  };
+
+  std::vector<Level> levels;
+
+  /*!
+   * Create an empty level with storage for whole tiles
+   * @param width Width in texels
+   * @param height Height in texels
+   * @return Level with uninitialized texels
+   */
+  static Level createLevel(int width, int height) {
+    int tilesX = (width + 3) / 4;
+    int tilesY = (height + 3) / 4;
+    return Level{width, height, tilesX, std::vector<uint32_t>((size_t) (tilesX * tilesY * 16))};
+  }
+
+  /*!
+   * Create a level from the pixels of an image, alpha is opaque
+   * @param image Pixels of the level
+   * @return Level with the texels of the image
+   */
+  static Level createLevel(const ppgso::Image &image) {
+    Level level = createLevel(image.width, image.height);
+    #pragma omp parallel for
+    for (int y = 0; y < image.height; y++) {
+      for (int x = 0; x < image.width; x++) {
+        auto &pixel = image.getFramebuffer()[y * image.width + x];
+        level.texels[index(level, x, y)] = pixel.r | pixel.g << 8 | pixel.b << 16 | 0xffu << 24;
+      }
+    }
+    return level;
+  }
+
+  /*!
+   * Compute storage index of a texel
+   * @param level Level the texel belongs to
+   * @param x Horizontal texel position
+   * @param y Vertical texel position
+   * @return Index into the level texels
+   */
+  static int index(const Level &level, int x, int y) {
+    // Interleave the two low bits of x and y
+    int morton = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2;
+    return ((y >> 2) * level.tilesX + (x >> 2)) * 16 + morton;
+  }
+
+  /*!
+   * Fetch a single texel
+   * @return RGBA8 texel, red in the lowest byte
+   */
+  static uint32_t fetch(const Level &level, int x, int y) {
+    return level.texels[index(level, x, y)];
+  }
+
+  /*!
+   * Bilinear sample of a level, texels outside of the level are clamped to the edge
+   * @param level Level to sample
+   * @param u Horizontal texture coordinate
+   * @param v Vertical texture coordinate
+   * @return Color with channels in lanes r, g, b, a in range <0, 255>
+   */
+  static float4 bilinear(const Level &level, float u, float v) {
+    float x = u * level.width - 0.5f;
+    float y = v * level.height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    int x0 = std::max((int) fx, 0), x1 = std::min((int) fx + 1, level.width - 1);
+    int y0 = std::max((int) fy, 0), y1 = std::min((int) fy + 1, level.height - 1);
+    float4 top = lerp(unpackBytes(fetch(level, x0, y0)), unpackBytes(fetch(level, x1, y0)), x - fx);
+    float4 bottom = lerp(unpackBytes(fetch(level, x0, y1)), unpackBytes(fetch(level, x1, y1)), x - fx);
+    return lerp(top, bottom, y - fy);
+  }
+};
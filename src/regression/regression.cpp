@@ -0,0 +1,208 @@
+// Regression check of the raw examples
+// - Compares the images rendered by raw2_raycast, raw3_raytrace and raw4_raster with stored reference images
+// - Run the examples in the data directory first, the regression target of the build does that and then runs this
+// - Ray tracers sample randomly from several threads so their images are noisy, they are downsampled to average the
+//   noise out and checked with PSNR and SSIM tolerances, the rasterizer is deterministic and a channel may only
+//   differ by two levels of rounding
+// - A heatmap of the differences is saved next to the images that fail, as <name>_diff.bmp
+// - Encoding edge cases of the QOI format the references are stored in are checked by a round trip first
+// - Usage: regression [--update] [reference directory]
+//          regression first second [heatmap.bmp]
+//   --update replaces the references with the current images after an intended change of the output
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <ppgso/ppgso.h>
+
+// Directory of the reference images relative to the data directory
+const std::string REFERENCE_DIRECTORY = "reference";
+
+/*!
+ * Image checked by the regression and the tolerances of its differences to the reference
+ */
+struct Check {
+  // Name of the rendered image without extension, the reference is a QOI image of the same name
+  std::string name;
+  // Number of times both images are downsampled to half the size before they are compared
+  int levels;
+  // Smallest PSNR in dB, smallest SSIM and largest difference of a channel that still pass
+  double psnr, ssim;
+  int maxError;
+};
+
+// Ray tracer tolerances leave room for the noise of different random samples, two runs of raw3_raytrace differ by
+// 40 dB PSNR and 0.97 SSIM at 1/8 of the size
+// The rasterizer only allows rounding of a channel by one level or two, builds with -O0, -march=native, -ffast-math and
+// without SSE2 differ from the references by at most one level in a few pixels
+const std::vector<Check> CHECKS = {
+    {"raw2_raycast", 1, 40.0, 0.99, 255},
+    {"raw3_raytrace", 3, 36.0, 0.93, 255},
+    {"raw4_raster", 0, 45.0, 0.999, 2},
+    {"raw4_raster_deferred", 0, 45.0, 0.999, 2},
+};
+
+/*!
+ * Load an image, the format is picked from the file extension
+ * @param filename Name of a BMP, QOI or PPM file
+ * @return Loaded image
+ */
+ppgso::Image loadImage(const std::string &filename) {
+  auto extension = filename.substr(filename.find_last_of('.') + 1);
+  if (extension == "qoi") return ppgso::image::loadQOI(filename);
+  if (extension == "ppm") return ppgso::image::loadPPM(filename);
+  return ppgso::image::loadBMP(filename);
+}
+
+/*!
+ * Downsample an image
+ * @param image Image to downsample
+ * @param levels Number of times the size is halved
+ * @return Downsampled image
+ */
+ppgso::Image downsample(const ppgso::Image &image, int levels) {
+  if (levels == 0) return image;
+  return std::move(ppgso::image::generateMipmaps(image.view())[levels - 1]);
+}
+
+/*!
+ * Print the differences of two images
+ * @param difference Differences of the images
+ * @param ssim Structural similarity of the images
+ */
+void printDifference(const ppgso::ImageDifference &difference, double ssim) {
+  std::cout << std::fixed << std::setprecision(4) << difference.pixels << " pixels differ, max error "
+            << difference.maxError << ", mean error " << difference.meanError << ", PSNR " << difference.psnr
+            << " dB, SSIM " << ssim << std::endl;
+}
+
+/*!
+ * Save an image as QOI and load it back, the image has to survive unchanged
+ * @param name Name of the round trip in the output
+ * @param image Image to encode
+ * @return True when the loaded image matches
+ */
+bool checkRoundTrip(const std::string &name, const ppgso::Image &image) {
+  const std::string filename = "regression_round_trip.qoi";
+  std::cout << "QOI " << name << ": ";
+  ppgso::image::saveQOI(image.view(), filename);
+  auto loaded = ppgso::image::loadQOI(filename);
+  std::remove(filename.c_str());
+  auto difference = ppgso::image::compare(image.view(), loaded.view());
+  if (!difference.identical()) {
+    std::cout << "FAILED, " << difference.pixels << " pixels differ" << std::endl;
+    return false;
+  }
+  std::cout << "ok" << std::endl;
+  return true;
+}
+
+/*!
+ * Check edge cases of the QOI encoder with round trips
+ * @return Number of failed checks
+ */
+int checkEncoder() {
+  int failed = 0;
+
+  // A run reaching the end of a row is flushed by the next row, which then needs the longest encoding for every pixel
+  const int width = 100;
+  ppgso::Image carriedRun{width, 2};
+  for (int x = 0; x < width; x++)
+    carriedRun.getPixel(x, 1) = {(uint8_t) (x * 97), (uint8_t) (x * 151 + 80), (uint8_t) (x * 53 + 160)};
+  if (!checkRoundTrip("run carried over a row", carriedRun)) failed++;
+
+  // Runs longer than the 62 pixels a single operation holds
+  ppgso::Image longRun{1000, 3};
+  for (int x = 0; x < longRun.width; x += 250)
+    longRun.getPixel(x, 1) = {255, 0, 0};
+  if (!checkRoundTrip("long runs", longRun)) failed++;
+  return failed;
+}
+
+/*!
+ * Compare two images given on the command line
+ * @return Exit code, failure when the images differ
+ */
+int compareImages(const std::string &first, const std::string &second, const std::string &heatmap) {
+  auto a = loadImage(first), b = loadImage(second);
+  auto difference = ppgso::image::compare(a.view(), b.view());
+  printDifference(difference, ppgso::image::ssim(a.view(), b.view()));
+  if (!heatmap.empty()) {
+    auto map = ppgso::image::heatmap(a.view(), b.view());
+    ppgso::image::saveBMP(map, heatmap);
+  }
+  return difference.identical() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+ * Compare the rendered images with the references
+ * @param directory Directory of the reference images
+ * @param update Replace the references with the rendered images instead of comparing
+ * @return Number of failed checks
+ */
+int checkImages(const std::string &directory, bool update) {
+  int failed = update ? 0 : checkEncoder();
+  for (auto &check : CHECKS) {
+    std::cout << check.name << ": ";
+    try {
+      auto image = ppgso::image::loadBMP(check.name + ".bmp");
+      auto reference = directory + "/" + check.name + ".qoi";
+      if (update) {
+        ppgso::image::saveQOI(image, reference);
+        std::cout << "updated " << reference << std::endl;
+        continue;
+      }
+
+      auto expected = ppgso::image::loadQOI(reference);
+      auto small = downsample(image, check.levels), smallExpected = downsample(expected, check.levels);
+      auto difference = ppgso::image::compare(small.view(), smallExpected.view());
+      double ssim = ppgso::image::ssim(small.view(), smallExpected.view());
+      if (check.levels)
+        std::cout << "at 1/" << (1 << check.levels) << " size ";
+      printDifference(difference, ssim);
+      if (difference.psnr < check.psnr || ssim < check.ssim || difference.maxError > check.maxError) {
+        failed++;
+        auto map = ppgso::image::heatmap(image.view(), expected.view());
+        ppgso::image::saveBMP(map, check.name + "_diff.bmp");
+        std::cout << "  FAILED, tolerances are PSNR " << check.psnr << " dB, SSIM " << check.ssim << ", max error "
+                  << check.maxError << ", see " << check.name << "_diff.bmp" << std::endl;
+      }
+    } catch (std::exception &e) {
+      failed++;
+      std::cout << e.what() << std::endl;
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> arguments{argv + 1, argv + argc};
+  bool update = !arguments.empty() && arguments[0] == "--update";
+  if (update)
+    arguments.erase(arguments.begin());
+
+  try {
+    if (!update && (arguments.size() == 2 || arguments.size() == 3))
+      return compareImages(arguments[0], arguments[1], arguments.size() == 3 ? arguments[2] : std::string{});
+    if (arguments.size() > 1) {
+      std::cout << "Usage: " << argv[0] << " [--update] [reference directory]" << std::endl;
+      std::cout << "       " << argv[0] << " first second [heatmap.bmp]" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    int failed = checkImages(arguments.empty() ? REFERENCE_DIRECTORY : arguments[0], update);
+    if (failed) {
+      std::cout << failed << " checks failed." << std::endl;
+      return EXIT_FAILURE;
+    }
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Done." << std::endl;
+  return EXIT_SUCCESS;
+}
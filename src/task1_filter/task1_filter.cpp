@@ -1,83 +1,756 @@
-// Task 1 - Load a 512x512 image lena.raw
-//        - Apply specified per-pixel transformation to each pixel
-//        - Save as result.raw
+// Task 1 - Load a RAW image, lena.raw (512x512 RAW RGB format) by default
+//        - Apply a chain of per-pixel operations to each pixel
+//        - Save as RAW image, result.raw by default
+// - The image is streamed in strips of whole rows so memory use does not depend on the size of the image
+// - A reader thread loads the next strips and a writer thread saves finished strips while the current strip is filtered,
+//   a fixed number of strip buffers is recycled between the threads
+// - Operations of the chain are ppgso::PointFilter steps, each filter processes its columns in a single pass
+// - The output is written to a temporary file that replaces it once the whole image is written, the input cannot be
+//   the output since rows are written while later rows are still read
+// - Usage: task1_filter [input.raw width height output.raw]
+//
+// Batch mode applies a filter chain to many images
+// - Inputs are file names, patterns with * and ? or @list files with one file name per line
+// - A pool of workers processes whole files concurrently, reading and writing is limited to a fixed number of files at
+//   once so the disk is not flooded with requests and memory use stays bounded
+// - Throughput of each file and of the whole batch is reported in MB/s of pixels
+// - Outputs that would replace an input or another output are rejected before any file is processed
+// - Usage: task1_filter -c chain [-o directory] [-f format] [-s widthxheight] [-j jobs] [-q depth] inputs...
+// - The chain is a comma separated list of steps, consecutive point steps are fused into one ppgso::PointFilter:
+//     gray[=r:g:b] gain=gain[:bias] invert gamma=gamma threshold=level
+//     box=radius gaussian=sigma sharpen edge half resize=widthxheight
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <ppgso/ppgso.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <glob.h>
+#endif
 
 // Grayscale constants
-#define GRAY_RED 0.299
-#define GRAY_GREEN 0.587
-#define GRAY_BLUE 0.114
+#define GRAY_RED 0.299f
+#define GRAY_GREEN 0.587f
+#define GRAY_BLUE 0.114f
 
 // Brightness constants
-#define BRIGHTNESS_FACTOR 1.5
+#define BRIGHTNESS_FACTOR 1.5f
+
+// Size of the default image
+const int SIZE = 512;
+
+// Approximate size of a strip in bytes and number of strips in flight
+const size_t STRIP_BYTES = 1 << 20;
+const int STRIP_COUNT = 4;
+
+// Default number of files read or written at once in batch mode
+const int IO_DEPTH = 2;
+
+using Pixel = ppgso::Image::Pixel;
+
+/*!
+ * Point filter of the chain limited to a range of columns
+ */
+struct Filter {
+  ppgso::PointFilter filter;
+  int left, right;
+};
+
+/*!
+ * Strip of whole rows of the image
+ */
+struct Strip {
+  std::vector<Pixel> pixels;
+  int top = 0, rows = 0;
+};
+
+/*!
+ * Queue passing strips between the pipeline stages, the number of strips is fixed so the queue is bounded
+ */
+class StripQueue {
+public:
+  void push(Strip strip) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      strips.push_back(std::move(strip));
+    }
+    changed.notify_one();
+  }
 
-// Size of the framebuffer
-const unsigned int SIZE = 512;
+  /*!
+   * Wait for the next strip
+   * @param strip Receives the strip
+   * @return False when the queue is closed and empty
+   */
+  bool pop(Strip &strip) {
+    std::unique_lock<std::mutex> lock{mutex};
+    changed.wait(lock, [this] { return !strips.empty() || closed; });
+    if (strips.empty()) return false;
+    strip = std::move(strips.front());
+    strips.pop_front();
+    return true;
+  }
+
+  /*!
+   * Close the queue, waiting stages stop once the queued strips are taken
+   */
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      closed = true;
+    }
+    changed.notify_all();
+  }
 
-// A simple RGB struct will represent a pixel in the framebuffer
-struct Pixel {
-    uint8_t r,g,b;
+private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Strip> strips;
+  bool closed = false;
 };
 
-int main()
-{
-  // Initialize a framebuffer
-  auto framebuffer = new Pixel[SIZE][SIZE];
+/*!
+ * Absolute path of a file with links, . and .. resolved, so different names of the same file compare equal
+ * @param path Name of the file, a file that does not exist yet is resolved through its directory
+ * @return Canonical path, the name itself when even the directory cannot be resolved
+ */
+std::string canonicalPath(const std::string &path) {
+#ifdef _WIN32
+  char full[MAX_PATH];
+  DWORD length = GetFullPathNameA(path.c_str(), MAX_PATH, full, nullptr);
+  if (length == 0 || length >= MAX_PATH)
+    return path;
+  // File names are not case sensitive
+  std::string result{full, length};
+  std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+  return result;
+#else
+  auto resolve = [](const std::string &name, std::string &result) {
+    char *resolved = realpath(name.c_str(), nullptr);
+    if (!resolved) return false;
+    result = resolved;
+    free(resolved);
+    return true;
+  };
+  std::string result;
+  if (resolve(path, result))
+    return result;
+  auto slash = path.find_last_of('/');
+  auto directory = slash == std::string::npos ? std::string{"."} : path.substr(0, slash == 0 ? 1 : slash);
+  if (!resolve(directory, result))
+    return path;
+  return result + (result.back() == '/' ? "" : "/") + path.substr(slash + 1);
+#endif
+}
 
-  // Open file lena.raw (this is 512x512 RAW GRB format)
-  std::ifstream inputFile("lena.raw", std::ios::binary);
+/*!
+ * Stream a RAW image through a filter chain
+ * @param input Name of the RAW file to read
+ * @param output Name of the RAW file to write
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param chain Filters to apply to each row in order
+ */
+void filterImage(const std::string &input, const std::string &output, int width, int height,
+                 const std::vector<Filter> &chain) {
+  // Rows are written while later rows are still read, so the input cannot be the output
+  if (canonicalPath(input) == canonicalPath(output))
+    throw std::runtime_error("Output " + output + " would overwrite the input");
+  std::ifstream inputFile(input, std::ios::binary);
   if (!inputFile)
-  {
-      std::cout << "Error while open lena.raw" << std::endl;
-      delete[] framebuffer;
-      return EXIT_FAILURE;
+    throw std::runtime_error("Error while open " + input);
+
+  // The output replaces an existing file only once the whole image is written
+  auto temporary = output + ".tmp";
+  std::ofstream outputFile(temporary, std::ios::binary);
+  if (!outputFile)
+    throw std::runtime_error("Error while open " + temporary);
+
+  // Strips hold whole rows, at least one
+  int stripRows = std::max(1, (int) (STRIP_BYTES / (width * sizeof(Pixel))));
+  StripQueue empty, loaded, filtered;
+  for (int i = 0; i < STRIP_COUNT; i++)
+    empty.push({std::vector<Pixel>((size_t) stripRows * width), 0, 0});
+
+  // The first error stops all stages
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  auto fail = [&] {
+    {
+      std::lock_guard<std::mutex> lock{errorMutex};
+      if (!error) error = std::current_exception();
+    }
+    empty.close();
+    loaded.close();
+    filtered.close();
+  };
+
+  std::thread reader{[&] {
+    try {
+      Strip strip;
+      for (int top = 0; top < height && empty.pop(strip); top += stripRows) {
+        strip.top = top;
+        strip.rows = std::min(stripRows, height - top);
+        inputFile.read(reinterpret_cast<char *>(strip.pixels.data()), (size_t) strip.rows * width * sizeof(Pixel));
+        if (!inputFile)
+          throw std::runtime_error(input + " is smaller than the image size");
+        loaded.push(std::move(strip));
+      }
+      loaded.close();
+    } catch (...) {
+      fail();
+    }
+  }};
+
+  std::thread writer{[&] {
+    try {
+      Strip strip;
+      while (filtered.pop(strip)) {
+        outputFile.write(reinterpret_cast<const char *>(strip.pixels.data()), (size_t) strip.rows * width * sizeof(Pixel));
+        if (!outputFile)
+          throw std::runtime_error("Error while writing " + output);
+        empty.push(std::move(strip));
+      }
+    } catch (...) {
+      fail();
+    }
+  }};
+
+  // Filter the strips on this thread, rows of a strip are processed in parallel
+  Strip strip;
+  while (loaded.pop(strip)) {
+    #pragma omp parallel for
+    for (int y = 0; y < strip.rows; y++) {
+      Pixel *row = &strip.pixels[(size_t) y * width];
+      for (auto &filter : chain) {
+        int left = std::max(filter.left, 0), right = std::min(filter.right, width);
+        if (left < right)
+          filter.filter.apply(row + left, right - left);
+      }
+    }
+    filtered.push(std::move(strip));
+  }
+  filtered.close();
+
+  reader.join();
+  writer.join();
+  outputFile.close();
+  if (!error && !outputFile)
+    error = std::make_exception_ptr(std::runtime_error("Error while writing " + output));
+  if (error) {
+    std::remove(temporary.c_str());
+    std::rethrow_exception(error);
+  }
+  // Renaming does not replace an existing file on Windows
+  std::remove(output.c_str());
+  if (std::rename(temporary.c_str(), output.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Error while renaming " + temporary + " to " + output);
+  }
+}
+
+/*!
+ * Step of a batch chain, either a fused point filter or an operation on the whole image that may change its size
+ */
+struct Stage {
+  ppgso::PointFilter filter;
+  std::function<void(ppgso::Image &)> transform;
+};
+
+/*!
+ * Options of batch mode
+ */
+struct Batch {
+  std::vector<Stage> chain;
+  std::vector<std::string> inputs;
+  // Output file of each input
+  std::vector<std::string> outputs;
+  std::string directory = ".", format;
+  int width = 0, height = 0;
+  int jobs = 0, depth = IO_DEPTH;
+};
+
+/*!
+ * Counting semaphore limiting the number of files read or written at once
+ */
+class Semaphore {
+public:
+  explicit Semaphore(int count) : count{count} {}
+
+  void acquire() {
+    std::unique_lock<std::mutex> lock{mutex};
+    changed.wait(lock, [this] { return count > 0; });
+    count--;
   }
 
-  // Read data to framebuffer and close the file
-  inputFile.read(reinterpret_cast<char*>(framebuffer), SIZE * SIZE * sizeof(Pixel));
-  inputFile.close();
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      count++;
+    }
+    changed.notify_one();
+  }
 
-  // Traverse the framebuffer
-  for (unsigned int y = 0; y < SIZE; y++) {
-      for (unsigned int x = 0; x < SIZE; x++) {
-          // Apply pixel operation
-          Pixel& pixel = framebuffer[y][x];
+private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  int count;
+};
 
-          if (x < SIZE / 2)
-          {
-              auto brightness = static_cast<uint8_t>(GRAY_RED * pixel.r + GRAY_GREEN * pixel.g + GRAY_BLUE * pixel.b);
+/*!
+ * Hold a semaphore for the lifetime of the object
+ */
+class SemaphoreLock {
+public:
+  explicit SemaphoreLock(Semaphore &semaphore) : semaphore(semaphore) {
+    semaphore.acquire();
+  }
 
-              pixel.r = brightness;
-              pixel.g = brightness;
-              pixel.b = brightness;
-          }
+  ~SemaphoreLock() {
+    semaphore.release();
+  }
+
+  SemaphoreLock(const SemaphoreLock &) = delete;
+  SemaphoreLock &operator=(const SemaphoreLock &) = delete;
+
+private:
+  Semaphore &semaphore;
+};
+
+/*!
+ * Split a string at a separator
+ * @param text String to split
+ * @param separator Character separating the parts
+ * @return Parts of the string, empty parts included
+ */
+std::vector<std::string> split(const std::string &text, char separator) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  for (;;) {
+    auto end = text.find(separator, start);
+    parts.push_back(text.substr(start, end - start));
+    if (end == std::string::npos) return parts;
+    start = end + 1;
+  }
+}
+
+/*!
+ * Parse a number of a command line argument
+ * @param text Number to parse
+ * @param name Name of the argument for error messages
+ * @return Parsed number
+ */
+float parseNumber(const std::string &text, const std::string &name) {
+  char *end = nullptr;
+  float number = std::strtof(text.c_str(), &end);
+  if (text.empty() || *end)
+    throw std::runtime_error("Invalid number " + text + " of " + name);
+  return number;
+}
+
+/*!
+ * Parse a size written as widthxheight
+ * @param text Size to parse
+ * @param name Name of the argument for error messages
+ * @param width Receives the width
+ * @param height Receives the height
+ */
+void parseSize(const std::string &text, const std::string &name, int &width, int &height) {
+  auto parts = split(text, 'x');
+  if (parts.size() != 2)
+    throw std::runtime_error("Invalid size " + text + " of " + name + ", use widthxheight");
+  width = (int) parseNumber(parts[0], name);
+  height = (int) parseNumber(parts[1], name);
+  if (width <= 0 || height <= 0)
+    throw std::runtime_error("Invalid size " + text + " of " + name);
+}
+
+/*!
+ * Parse a filter chain, consecutive point steps are fused into one stage so each pixel is loaded only once for them
+ * @param spec Comma separated steps, arguments follow = and are separated by :
+ * @return Stages of the chain
+ */
+std::vector<Stage> parseChain(const std::string &spec) {
+  std::vector<Stage> chain;
+  // Point filter of the last stage, a new stage is started after a transform
+  auto point = [&chain]() -> ppgso::PointFilter & {
+    if (chain.empty() || chain.back().transform)
+      chain.emplace_back();
+    return chain.back().filter;
+  };
+  auto transform = [&chain](std::function<void(ppgso::Image &)> operation) {
+    chain.emplace_back();
+    chain.back().transform = std::move(operation);
+  };
+
+  for (auto &step : split(spec, ',')) {
+    auto equals = step.find('=');
+    auto name = step.substr(0, equals);
+    auto arguments = equals == std::string::npos ? std::vector<std::string>{} : split(step.substr(equals + 1), ':');
+    auto argument = [&](size_t i, float fallback) {
+      return i < arguments.size() ? parseNumber(arguments[i], step) : fallback;
+    };
+    auto expect = [&](size_t minimum, size_t maximum) {
+      if (arguments.size() < minimum || arguments.size() > maximum)
+        throw std::runtime_error("Wrong number of arguments of step " + step);
+    };
+
+    if (name == "gray") {
+      expect(0, 3);
+      if (arguments.size() == 1 || arguments.size() == 2)
+        throw std::runtime_error("Step gray needs all three weights");
+      point().luminance(argument(0, GRAY_RED), argument(1, GRAY_GREEN), argument(2, GRAY_BLUE));
+    } else if (name == "gain") {
+      expect(1, 2);
+      point().gainBias(argument(0, 1.0f), argument(1, 0.0f));
+    } else if (name == "invert") {
+      expect(0, 0);
+      point().gainBias(-1.0f, 255.0f);
+    } else if (name == "gamma") {
+      expect(1, 1);
+      point().gamma(argument(0, 1.0f));
+    } else if (name == "threshold") {
+      expect(1, 1);
+      point().threshold((uint8_t) std::min(std::max(argument(0, 128.0f), 0.0f), 255.0f));
+    } else if (name == "box") {
+      expect(1, 1);
+      int radius = (int) argument(0, 1.0f);
+      transform([radius](ppgso::Image &image) {
+        ppgso::image::boxBlur(image.view(), image.span(), radius);
+      });
+    } else if (name == "gaussian") {
+      expect(1, 1);
+      float sigma = argument(0, 1.0f);
+      transform([sigma](ppgso::Image &image) {
+        ppgso::image::gaussianBlur(image.view(), image.span(), sigma);
+      });
+    } else if (name == "sharpen" || name == "edge") {
+      expect(0, 0);
+      auto kernel = name == "sharpen" ?
+                    ppgso::ConvolutionKernel{{0, -1, 0, -1, 5, -1, 0, -1, 0}, 3} :
+                    ppgso::ConvolutionKernel{{-1, -1, -1, -1, 8, -1, -1, -1, -1}, 3};
+      transform([kernel](ppgso::Image &image) {
+        kernel.apply(image.view(), image.span());
+      });
+    } else if (name == "half") {
+      expect(0, 0);
+      transform([](ppgso::Image &image) {
+        ppgso::Image half{std::max(image.width / 2, 1), std::max(image.height / 2, 1)};
+        ppgso::image::downsample(image.view(), half.span());
+        image = std::move(half);
+      });
+    } else if (name == "resize") {
+      expect(1, 1);
+      int width, height;
+      parseSize(arguments[0], step, width, height);
+      transform([width, height](ppgso::Image &image) {
+        image = ppgso::image::resize(image.view(), width, height);
+      });
+    } else {
+      throw std::runtime_error("Unknown step " + step);
+    }
+  }
+  return chain;
+}
+
+/*!
+ * Expand an input argument into file names
+ * @param argument File name, pattern with * and ? or @ followed by the name of a file listing one file name per line
+ * @param inputs Receives the file names
+ */
+void expandInput(const std::string &argument, std::vector<std::string> &inputs) {
+  if (!argument.empty() && argument[0] == '@') {
+    std::ifstream list(argument.substr(1));
+    if (!list)
+      throw std::runtime_error("Error while open " + argument.substr(1));
+    std::string line;
+    while (std::getline(list, line)) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty()) inputs.push_back(line);
+    }
+    return;
+  }
+  if (argument.find_first_of("*?") == std::string::npos) {
+    inputs.push_back(argument);
+    return;
+  }
+
+  // Patterns that match nothing are an error so a typo does not silently process no files
+  size_t count = inputs.size();
+#ifdef _WIN32
+  auto slash = argument.find_last_of("/\\");
+  auto directory = slash == std::string::npos ? std::string{} : argument.substr(0, slash + 1);
+  WIN32_FIND_DATAA found;
+  HANDLE search = FindFirstFileA(argument.c_str(), &found);
+  if (search != INVALID_HANDLE_VALUE) {
+    do {
+      if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        inputs.push_back(directory + found.cFileName);
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+  }
+  std::sort(inputs.begin() + count, inputs.end());
+#else
+  glob_t found;
+  if (glob(argument.c_str(), 0, nullptr, &found) == 0) {
+    for (size_t i = 0; i < found.gl_pathc; i++)
+      inputs.emplace_back(found.gl_pathv[i]);
+  }
+  globfree(&found);
+#endif
+  if (inputs.size() == count)
+    throw std::runtime_error("No files match " + argument);
+}
+
+/*!
+ * Load an image, the format is picked from the file extension
+ * @param input Name of the file
+ * @param width Width of RAW images
+ * @param height Height of RAW images
+ * @return Loaded image
+ */
+ppgso::Image loadImage(const std::string &input, int width, int height) {
+  auto dot = input.find_last_of('.');
+  auto extension = dot == std::string::npos ? std::string{} : input.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  if (extension == "bmp") return ppgso::image::loadBMP(input);
+  if (extension == "qoi") return ppgso::image::loadQOI(input);
+  if (extension == "ppm") return ppgso::image::loadPPM(input);
+  if (extension == "raw") {
+    if (width <= 0 || height <= 0)
+      throw std::runtime_error("Size of RAW image " + input + " is unknown, use -s widthxheight");
+    return ppgso::image::loadRAW(input, width, height);
+  }
+  throw std::runtime_error("Unknown image format of file " + input);
+}
+
+/*!
+ * Name of the output file of an input
+ * @param input Name of the input file
+ * @param batch Options with the output directory and format
+ * @return Name of the output file
+ */
+std::string outputName(const std::string &input, const Batch &batch) {
+  auto slash = input.find_last_of("/\\");
+  auto name = slash == std::string::npos ? input : input.substr(slash + 1);
+  if (!batch.format.empty())
+    name = name.substr(0, name.find_last_of('.')) + "." + batch.format;
+  return batch.directory + "/" + name;
+}
+
+/*!
+ * Process all inputs of a batch, files are taken by a pool of workers
+ * @param batch Options of the batch
+ * @return Number of files that failed
+ */
+int processBatch(const Batch &batch) {
+  using Clock = std::chrono::steady_clock;
+  auto milliseconds = [](Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  };
+
+  int jobs = std::min(batch.jobs > 0 ? batch.jobs : std::max((int) std::thread::hardware_concurrency(), 1),
+                      (int) batch.inputs.size());
+  Semaphore io{batch.depth};
+  std::atomic<size_t> next{0};
+  std::atomic<int> failed{0};
+  std::atomic<uint64_t> total{0};
+  std::mutex print;
+
+  auto start = Clock::now();
+  auto work = [&] {
+#ifdef _OPENMP
+    // Split the cores between the workers instead of each worker starting a thread per core
+    omp_set_num_threads(std::max(omp_get_num_procs() / jobs, 1));
+#endif
+    for (size_t i = next++; i < batch.inputs.size(); i = next++) {
+      auto &input = batch.inputs[i];
+      auto &output = batch.outputs[i];
+      try {
+        auto begin = Clock::now();
+        ppgso::Image image{0, 0};
+        {
+          SemaphoreLock lock{io};
+          image = loadImage(input, batch.width, batch.height);
+        }
+        auto loaded = Clock::now();
+        auto bytes = (uint64_t) image.width * image.height * sizeof(Pixel);
+        for (auto &stage : batch.chain) {
+          if (stage.transform)
+            stage.transform(image);
           else
-          {
-              pixel.r = static_cast<uint8_t>(std::min(static_cast<int>(pixel.r * BRIGHTNESS_FACTOR), 255));
-              pixel.g = static_cast<uint8_t>(std::min(static_cast<int>(pixel.g * BRIGHTNESS_FACTOR), 255));
-              pixel.b = static_cast<uint8_t>(std::min(static_cast<int>(pixel.b * BRIGHTNESS_FACTOR), 255));
-          }
+            stage.filter.apply(image.span());
+        }
+        auto filtered = Clock::now();
+        {
+          SemaphoreLock lock{io};
+          ppgso::ImageWriter::save(image.view(), output);
+        }
+        auto saved = Clock::now();
+        total += bytes;
 
+        std::lock_guard<std::mutex> lock{print};
+        std::cout << output << " " << std::fixed << std::setprecision(1)
+                  << bytes / 1e6 << " MB, load " << milliseconds(begin, loaded) << " ms, filter "
+                  << milliseconds(loaded, filtered) << " ms, save " << milliseconds(filtered, saved) << " ms, "
+                  << bytes / 1e3 / std::max(milliseconds(begin, saved), 1e-3) << " MB/s" << std::endl;
+      } catch (std::exception &e) {
+        failed++;
+        std::lock_guard<std::mutex> lock{print};
+        std::cout << input << ": " << e.what() << std::endl;
       }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < jobs; i++)
+    workers.emplace_back(work);
+  work();
+  for (auto &worker : workers)
+    worker.join();
+
+  double elapsed = milliseconds(start, Clock::now());
+  std::cout << batch.inputs.size() - failed << " of " << batch.inputs.size() << " files, " << std::fixed
+            << std::setprecision(1) << total / 1e6 << " MB in " << elapsed << " ms on " << jobs << " workers, "
+            << total / 1e3 / std::max(elapsed, 1e-3) << " MB/s" << std::endl;
+  return failed;
+}
+
+/*!
+ * Parse the options of batch mode
+ * @param argc Number of arguments
+ * @param argv Arguments, the first one is the program name
+ * @return Options of the batch
+ */
+Batch parseBatch(int argc, char *argv[]) {
+  Batch batch;
+  bool chain = false;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    if (argument.size() == 2 && argument[0] == '-') {
+      if (i + 1 == argc)
+        throw std::runtime_error("Missing value of " + argument);
+      std::string value = argv[++i];
+      switch (argument[1]) {
+        case 'c':
+          batch.chain = parseChain(value);
+          chain = true;
+          break;
+        case 'o':
+          batch.directory = value;
+          break;
+        case 'f':
+          batch.format = value;
+          break;
+        case 's':
+          parseSize(value, argument, batch.width, batch.height);
+          break;
+        case 'j':
+          batch.jobs = (int) parseNumber(value, argument);
+          break;
+        case 'q':
+          batch.depth = (int) parseNumber(value, argument);
+          break;
+        default:
+          throw std::runtime_error("Unknown option " + argument);
+      }
+    } else {
+      expandInput(argument, batch.inputs);
+    }
   }
+  if (!chain)
+    throw std::runtime_error("Missing filter chain, use -c chain");
+  if (batch.inputs.empty())
+    throw std::runtime_error("No input files");
+  if (batch.depth <= 0)
+    throw std::runtime_error("I/O depth has to be positive");
+
+  // Outputs may neither replace an input nor each other, workers would otherwise write the same file at once
+  std::set<std::string> sources;
+  for (auto &input : batch.inputs)
+    sources.insert(canonicalPath(input));
+  std::map<std::string, std::string> targets;
+  for (auto &input : batch.inputs) {
+    auto output = outputName(input, batch);
+    auto target = canonicalPath(output);
+    if (sources.count(target))
+      throw std::runtime_error("Output " + output + " would overwrite an input, use -o directory");
+    auto inserted = targets.emplace(target, input);
+    if (!inserted.second)
+      throw std::runtime_error("Inputs " + inserted.first->second + " and " + input + " would both be saved to " + output);
+    batch.outputs.push_back(output);
+  }
+  return batch;
+}
 
-  // Open file result.raw
-  std::ofstream outputFile("result.raw", std::ios::binary);
-  if (!outputFile) {
-      std::cout << "Error while open result.raw" << std::endl;
-      delete[] framebuffer;
+int main(int argc, char *argv[]) {
+  // Options select batch mode
+  if (argc > 1 && argv[1][0] == '-') {
+    try {
+      return processBatch(parseBatch(argc, argv)) ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (std::exception &e) {
+      std::cout << e.what() << std::endl;
+      std::cout << "Usage: " << argv[0] << " -c chain [-o directory] [-f format] [-s widthxheight] [-j jobs] [-q depth] "
+                << "inputs..." << std::endl;
       return EXIT_FAILURE;
+    }
   }
 
-  std::cout << "Generating result.raw file ..." << std::endl;
+  std::string input = "lena.raw", output = "result.raw";
+  int width = SIZE, height = SIZE;
+  if (argc == 5) {
+    input = argv[1];
+    width = std::atoi(argv[2]);
+    height = std::atoi(argv[3]);
+    output = argv[4];
+  }
+  if ((argc != 1 && argc != 5) || width <= 0 || height <= 0) {
+    std::cout << "Usage: " << argv[0] << " [input.raw width height output.raw]" << std::endl;
+    std::cout << "       " << argv[0] << " -c chain [-o directory] [-f format] [-s widthxheight] [-j jobs] [-q depth] "
+              << "inputs..." << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  // Write the framebuffer to the file and close it
-  outputFile.write(reinterpret_cast<const char*>(framebuffer), SIZE * SIZE * sizeof(Pixel));
-  outputFile.close();
+  // Grayscale on the left half and brighter colors on the right half
+  ppgso::PointFilter grayscale, brightness;
+  grayscale.luminance(GRAY_RED, GRAY_GREEN, GRAY_BLUE);
+  brightness.gainBias(BRIGHTNESS_FACTOR);
+  std::vector<Filter> chain = {
+      {grayscale, 0, width / 2},
+      {brightness, width / 2, width},
+  };
+
+  std::cout << "Generating " << output << " file ..." << std::endl;
+  try {
+    filterImage(input, output, width, height, chain);
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
 
   std::cout << "Done." << std::endl;
-  delete[] framebuffer;
   return EXIT_SUCCESS;
 }
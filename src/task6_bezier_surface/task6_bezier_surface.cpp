@@ -191,7 +191,7 @@ public:
 
 int main() {
   // Create new window
-  auto window = BezierSurfaceWindow{};
+  BezierSurfaceWindow window;
 
   // Main execution loop
   while (window.pollEvents()) {}